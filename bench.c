@@ -0,0 +1,239 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/** rtl_868_bench: decode a synthetic capture in memory and report the
+ * throughput, the decode success rate and the time spent per stage.
+ * The bit decoder and the stream decoders are wrapped by timers, the
+ * time of each stage is what remains after subtracting the next one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "siggen.h"
+#include "transmission.h"
+#include "nrz_decode.h"
+#include "nrz_stream.h"
+#include "stream_dispatch.h"
+#include "ws300.h"
+#include "tx29.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "sample_rate.h"
+#include "logging.h"
+
+static long long bn_ns( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* timed bit decoder */
+
+typedef struct {
+  bit_decoder_t *inner;
+  long long ns;
+} bn_bit_t;
+
+int bn_bit_init( bit_decoder_t *self, stream_decoder_t *next ) {
+  bn_bit_t *c = self->ctx;
+  return c->inner->init( c->inner, next );
+}
+
+int bn_bit_input( bit_decoder_t *self, const int16_t t[], unsigned int length, const rx_info_t *rx ) {
+  bn_bit_t *c = self->ctx;
+  long long t0 = bn_ns();
+  int res = c->inner->input( c->inner, t, length, rx );
+  c->ns += bn_ns() - t0;
+  return res;
+}
+
+int bn_bit_begin( bit_decoder_t *self, int noise ) {
+  bn_bit_t *c = self->ctx;
+  long long t0 = bn_ns();
+  int res = c->inner->begin( c->inner, noise );
+  c->ns += bn_ns() - t0;
+  return res;
+}
+
+int bn_bit_samples( bit_decoder_t *self, const int16_t s[], unsigned int length ) {
+  bn_bit_t *c = self->ctx;
+  long long t0 = bn_ns();
+  int res = c->inner->samples( c->inner, s, length );
+  c->ns += bn_ns() - t0;
+  return res;
+}
+
+int bn_bit_end( bit_decoder_t *self, int accept, const rx_info_t *rx ) {
+  bn_bit_t *c = self->ctx;
+  long long t0 = bn_ns();
+  int res = c->inner->end( c->inner, accept, rx );
+  c->ns += bn_ns() - t0;
+  return res;
+}
+
+/* timed stream decoder */
+
+typedef struct {
+  stream_decoder_t *inner;
+  long long ns;
+} bn_stream_t;
+
+int bn_stream_input( stream_decoder_t *self, int t[], unsigned length, const rx_info_t *rx ) {
+  bn_stream_t *c = self->ctx;
+  long long t0 = bn_ns();
+  int res = c->inner->input( c->inner, t, length, rx );
+  c->ns += bn_ns() - t0;
+  return res;
+}
+
+/* logger comparing the records with the generated frames */
+
+typedef struct {
+  const siggen_t *g;
+  unsigned int next;        ///< first frame not matched yet
+  unsigned int matched;
+  unsigned int wrong;
+} bn_log_t;
+
+/// records are looked for this many frames ahead of the last match
+#define BN_WINDOW 8
+
+int bn_log_input( data_logger_t *self, const dl_record_t *r ) {
+  bn_log_t *c = self->ctx;
+  unsigned int i;
+  for (i = c->next; (i < c->g->n_frames) && (i < c->next + BN_WINDOW); i++) {
+    const siggen_frame_t *f = &c->g->frames[i];
+    if ((f->sensor_id == r->sensor_id) && (f->rel_hum == r->rel_hum) &&
+        (f->temp - r->temp < 0.05) && (r->temp - f->temp < 0.05)) {
+      c->matched++;
+      c->next = i + 1;
+      return 0;
+    }
+  }
+  c->wrong++;
+  return 0;
+}
+
+typedef struct {
+  long long total, bit, stream;
+  unsigned int matched, wrong;
+} bn_result_t;
+
+/** decode the capture once with a fresh chain */
+static int bn_run( const siggen_t *g, bit_decoder_t *(*bd_create)( void ), bn_result_t *r ) {
+  bn_bit_t bc = { .inner = bd_create() };
+  bn_stream_t sc = { .inner = dispatch_create() };
+  bn_log_t lc = { .g = g };
+  bit_decoder_t bit = { .name = "timer", .shorthand = "bn_bit", .ctx = &bc,
+    .init = bn_bit_init, .input = bn_bit_input };
+  stream_decoder_t stream = { .name = "timer", .shorthand = "bn_stream", .ctx = &sc,
+    .input = bn_stream_input };
+  data_logger_t log = { .name = "checker", .shorthand = "bn_log", .ctx = &lc,
+    .input = bn_log_input };
+  sample_decoder_t *sd = td_create();
+  if ((sd == 0) || (bc.inner == 0) || (sc.inner == 0) ||
+      (dispatch_add( sc.inner, ws300_create() ) != 0) || (dispatch_add( sc.inner, tx29_create() ) != 0))
+    return -1;
+  if (bc.inner->begin != 0) {
+    bit.begin = bn_bit_begin;
+    bit.samples = bn_bit_samples;
+    bit.end = bn_bit_end;
+  }
+  if ((sd->init( sd, &bit ) != 0) || (bit.init( &bit, &stream ) != 0) || (sc.inner->init( sc.inner, &log ) != 0))
+    return -1;
+  size_t i;
+  long long t0 = bn_ns();
+  for (i = 0; i < g->length; i += PIPELINE_BLOCK)
+    sd->input_block( sd, &g->samples[i], g->length - i < PIPELINE_BLOCK ? g->length - i : PIPELINE_BLOCK );
+  r->total = bn_ns() - t0;
+  r->bit = bc.ns;
+  r->stream = sc.ns;
+  r->matched = lc.matched;
+  r->wrong = lc.wrong;
+  sd->destroy( sd );
+  bc.inner->destroy( bc.inner );
+  sc.inner->destroy( sc.inner );
+  return 0;
+}
+
+int main( int argc, char **argv ) {
+  siggen_params_t p;
+  siggen_t g;
+  bit_decoder_t *(*bd_create)( void ) = nrz_create;
+  const char *bd_name = "nrz";
+  int repeats = 5;
+  int c, i;
+
+  logging_init();
+  verbose = -1;
+  siggen_defaults( &p );
+  p.frames = 400;
+  p.density = 20;
+  while ((c = getopt( argc, argv, "n:S:b:O:d:x:s:r:R:z" )) != -1)
+    switch (c) {
+      case 'n': p.frames = atoi( optarg ); break;
+      case 'S': p.snr = atof( optarg ); break;
+      case 'b': p.bitrate = atof( optarg ); break;
+      case 'O': p.offset = atof( optarg ); break;
+      case 'd': p.density = atof( optarg ); break;
+      case 'x': p.tx29 = atof( optarg ); break;
+      case 's': p.seed = atoi( optarg ); break;
+      case 'r': p.rate = atoi( optarg ); break;
+      case 'R': repeats = atoi( optarg ); break;
+      case 'z': bd_create = nrzs_create; bd_name = "nrzs"; break;
+      default:
+        fprintf( stderr,
+          "Usage: rtl_868_bench [PARAMETERS]\n"
+          "      -n, -S, -b, -O, -d, -x, -s, -r  as for rtl_868_gen, defaults to\n"
+          "                  %u frames at %1.0f frames/s.\n"
+          "      -R n        decode n times and report the fastest, defaults to %i.\n"
+          "      -z          use the streaming NRZ decoder.\n",
+          p.frames, p.density, repeats );
+        return 1;
+    }
+  if (repeats < 1) repeats = 1;
+  srate_set( p.rate );
+  if ((siggen_generate( &p, &g ) != 0) || (pool_chain( p.rate, 1 ) != 0))
+    return 1;
+
+  bn_result_t best = { 0 }, r;
+  for (i = 0; i < repeats; i++) {
+    if (bn_run( &g, bd_create, &r ) != 0) {
+      fprintf( stderr, "Could not set up the decoders.\n" );
+      return 1;
+    }
+    if ((i == 0) || (r.total < best.total))
+      best = r;
+  }
+
+  double n = g.length;
+  double s = best.total / 1e9;
+  printf( "%u frames, %1.1f dB, bit rate x%1.2f, offset %1.0f Hz, %1.1f frames/s, %lu samples (%1.1fs at %u S/s)\n",
+    g.n_frames, p.snr, p.bitrate, p.offset, p.density, (unsigned long)g.length, n / p.rate, p.rate );
+  printf( "  %-4s  %7.2f MS/s (%1.0fx real time), %1.0f frames/s, %u/%u decoded (%1.1f%%), %u wrong\n",
+    bd_name, n / s / 1e6, n / s / p.rate, best.matched / s, best.matched, g.n_frames,
+    g.n_frames ? 100.0 * best.matched / g.n_frames : 0.0, best.wrong );
+  printf( "  ns/sample: td %1.3f, %s %1.3f, decoders %1.3f, total %1.3f\n",
+    (best.total - best.bit) / n, bd_name, (best.bit - best.stream) / n, best.stream / n, best.total / n );
+  siggen_free( &g );
+  return 0;
+}
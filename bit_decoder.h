@@ -22,15 +22,28 @@
 #define BIT_DECODER_H 1
 
 #include "stream_decoder.h"
+#include <stdint.h>
 
-/* interface for bit decoder */
-typedef struct {
+/* interface for bit decoder, instances work like sample decoders */
+typedef struct bit_decoder bit_decoder_t;
+struct bit_decoder {
   char *name;
   char *shorthand;
+  void *ctx;  ///< state of this instance
   // interface
-  int (*init)(stream_decoder_t *next);
-  int (*input)(int transmission[], unsigned int length, int noise, int signal);
-} bit_decoder_t;
+  int (*init)(bit_decoder_t *self, stream_decoder_t *next);
+  /// transmission points into the sample decoders buffer and is only
+  /// valid during the call, so is rx
+  int (*input)(bit_decoder_t *self, const int16_t transmission[], unsigned int length, const rx_info_t *rx);
+  // optional streaming interface. If present, the sample decoder calls
+  // begin() when a transmission starts, samples() for every new piece of
+  // it and end() when it is over, instead of input(). accept is 0 if the
+  // sample decoder discarded the transmission (too short or too weak).
+  int (*begin)(bit_decoder_t *self, int noise);
+  int (*samples)(bit_decoder_t *self, const int16_t samples[], unsigned int length);
+  int (*end)(bit_decoder_t *self, int accept, const rx_info_t *rx);
+  void (*destroy)(bit_decoder_t *self);
+};
 
 
 
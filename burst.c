@@ -0,0 +1,279 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "logging.h"
+#include "burst.h"
+#include "trace.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define BURST_HEADER 16
+#define BURST_RECORD 28
+/// samples encoded at a time
+#define BURST_CHUNK 512
+
+/// the capture written by all tees, channels write from their threads
+static FILE *burst_out = 0;
+static pthread_mutex_t burst_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* little endian encoding */
+
+static uint8_t *bu_put32( uint8_t *p, uint32_t v ) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+  return p + 4;
+}
+static uint8_t *bu_put64( uint8_t *p, uint64_t v ) {
+  p = bu_put32( p, (uint32_t)v );
+  return bu_put32( p, (uint32_t)(v >> 32) );
+}
+static uint32_t bu_get32( const uint8_t *p ) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint64_t bu_get64( const uint8_t *p ) {
+  return bu_get32( p ) | ((uint64_t)bu_get32( p + 4 ) << 32);
+}
+
+int burst_record( const char *filename, double rate ) {
+  struct stat st;
+  burst_out = fopen( filename, "ab" );
+  if (burst_out == 0) {
+    logging_error( "Could not open the burst capture '%s'.\n", filename );
+    return -1;
+  }
+  // files appended to already have their header
+  if ((fstat( fileno( burst_out ), &st ) != 0) || !S_ISREG( st.st_mode ) || (st.st_size == 0)) {
+    uint8_t h[BURST_HEADER];
+    memcpy( h, "RTL868T1", 8 );
+    bu_put32( bu_put32( h + 8, BURST_VERSION ), (uint32_t)(rate + 0.5) );
+    if (fwrite( h, 1, sizeof(h), burst_out ) != sizeof(h)) {
+      logging_error( "Could not write the burst capture.\n" );
+      return -1;
+    }
+  }
+  logging_info( "Recording bursts to '%s'.\n", filename );
+  return 0;
+}
+
+void burst_close( void ) {
+  pthread_mutex_lock( &burst_lock );
+  if (burst_out != 0)
+    fclose( burst_out );
+  burst_out = 0;
+  pthread_mutex_unlock( &burst_lock );
+}
+
+/** append one burst to the capture */
+static int burst_write( const int16_t samples[], unsigned int length, int onset, const rx_info_t *rx ) {
+  uint8_t buf[2 * BURST_CHUNK];
+  unsigned int i, j;
+  int res = 0;
+  memcpy( buf, "BST1", 4 );
+  uint8_t *p = bu_put32( buf + 4, length );
+  p = bu_put64( p, rx->sample );
+  p = bu_put32( p, rx->noise );
+  p = bu_put32( p, rx->signal );
+  bu_put32( p, onset );
+  pthread_mutex_lock( &burst_lock );
+  if (burst_out == 0)
+    goto out;
+  if (fwrite( buf, 1, BURST_RECORD, burst_out ) != BURST_RECORD)
+    res = -1;
+  for (i = 0; (res == 0) && (i < length); i += j) {
+    for (j = 0; (j < BURST_CHUNK) && (i + j < length); j++) {
+      buf[2*j] = samples[i + j];
+      buf[2*j + 1] = (uint16_t)samples[i + j] >> 8;
+    }
+    if (fwrite( buf, 2, j, burst_out ) != j)
+      res = -1;
+  }
+  // a capture is an archive, keep what is recorded if we are killed
+  if ((res != 0) || (fflush( burst_out ) != 0)) {
+    logging_error( "Could not write the burst capture.\n" );
+    res = -1;
+  }
+out:
+  pthread_mutex_unlock( &burst_lock );
+  return res;
+}
+
+/* tee */
+
+/* state of one tee */
+typedef struct {
+  bit_decoder_t *next;
+  /// streaming: the samples of the running transmission, from the pool
+  int16_t *buf;
+  unsigned int len, size;
+  int onset;
+  /// the running transmission did not fit buf
+  int truncated;
+} burst_tee_ctx_t;
+
+int burst_tee_init( bit_decoder_t *self, stream_decoder_t *next ) {
+  burst_tee_ctx_t *c = self->ctx;
+  return c->next->init( c->next, next );
+}
+
+int burst_tee_input( bit_decoder_t *self, const int16_t transmission[], unsigned int length, const rx_info_t *rx ) {
+  burst_tee_ctx_t *c = self->ctx;
+  burst_write( transmission, length, rx->noise, rx );
+  return c->next->input( c->next, transmission, length, rx );
+}
+
+int burst_tee_begin( bit_decoder_t *self, int noise ) {
+  burst_tee_ctx_t *c = self->ctx;
+  c->len = 0;
+  c->onset = noise;
+  c->truncated = 0;
+  return c->next->begin( c->next, noise );
+}
+
+int burst_tee_samples( bit_decoder_t *self, const int16_t samples[], unsigned int length ) {
+  burst_tee_ctx_t *c = self->ctx;
+  unsigned int n = length;
+  if (c->len + n > c->size) {
+    if (!c->truncated)
+      logging_warning( "Burst exceeds %u samples, recording only its start.\n", c->size );
+    c->truncated = 1;
+    n = c->size - c->len;
+  }
+  memcpy( &c->buf[c->len], samples, n * sizeof(samples[0]) );
+  c->len += n;
+  return c->next->samples( c->next, samples, length );
+}
+
+int burst_tee_end( bit_decoder_t *self, int accept, const rx_info_t *rx ) {
+  burst_tee_ctx_t *c = self->ctx;
+  if (accept)
+    burst_write( c->buf, c->len, c->onset, rx );
+  return c->next->end( c->next, accept, rx );
+}
+
+void burst_tee_destroy( bit_decoder_t *self ) {
+  burst_tee_ctx_t *c = self->ctx;
+  c->next->destroy( c->next );
+  pool_put( pool_class( POOL_SAMPLES ), c->buf );
+  free( c );
+  free( self );
+}
+
+bit_decoder_t *burst_tee_create( bit_decoder_t *next ) {
+  if (next == 0)
+    return 0;
+  bit_decoder_t *self = malloc( sizeof(*self) );
+  burst_tee_ctx_t *c = calloc( 1, sizeof(*c) );
+  pool_t *pool = pool_class( POOL_SAMPLES );
+  if ((self == 0) || (c == 0) || (pool == 0) || ((c->buf = pool_get( pool )) == 0)) {
+    logging_error( "Could not allocate a burst recorder.\n" );
+    free( self );
+    free( c );
+    next->destroy( next );
+    return 0;
+  }
+  c->size = pool_size( pool ) / sizeof(c->buf[0]);
+  c->next = next;
+  // the same interface as next, so the sample decoder drives both alike
+  *self = (bit_decoder_t){
+    .name = "Burst recorder",
+    .shorthand = "burst",
+    .ctx = c,
+    .init = burst_tee_init,
+    .input = burst_tee_input,
+    .begin = next->begin != 0 ? burst_tee_begin : 0,
+    .samples = next->begin != 0 ? burst_tee_samples : 0,
+    .end = next->begin != 0 ? burst_tee_end : 0,
+    .destroy = burst_tee_destroy
+  };
+  return self;
+}
+
+/* replay */
+
+int burst_open( FILE *in, double *rate ) {
+  uint8_t h[BURST_HEADER];
+  if ((fread( h, 1, sizeof(h), in ) != sizeof(h)) || (memcmp( h, "RTL868T1", 8 ) != 0)) {
+    logging_error( "Not a burst capture.\n" );
+    return -1;
+  }
+  if (bu_get32( h + 8 ) != BURST_VERSION) {
+    logging_error( "Unsupported burst capture version %u.\n", bu_get32( h + 8 ) );
+    return -1;
+  }
+  *rate = bu_get32( h + 12 );
+  return 0;
+}
+
+long burst_replay( FILE *in, bit_decoder_t *bd ) {
+  uint8_t h[BURST_RECORD];
+  pool_t *pool = pool_class( POOL_SAMPLES );
+  int16_t *buf = pool == 0 ? 0 : pool_get( pool );
+  if (buf == 0) {
+    logging_error( "Could not get a buffer for the bursts.\n" );
+    return -1;
+  }
+  unsigned int i, size = pool_size( pool ) / sizeof(buf[0]);
+  long bursts = 0;
+  size_t got;
+  while ((got = fread( h, 1, sizeof(h), in )) == sizeof(h)) {
+    if (memcmp( h, "BST1", 4 ) != 0) {
+      logging_error( "Invalid burst %li in the capture.\n", bursts );
+      pool_put( pool, buf );
+      return -1;
+    }
+    unsigned int n = bu_get32( h + 4 );
+    rx_info_t rx = {
+      .sample = bu_get64( h + 8 ),
+      .noise = (int32_t)bu_get32( h + 16 ),
+      .signal = (int32_t)bu_get32( h + 20 )
+    };
+    int onset = (int32_t)bu_get32( h + 24 );
+    // e.g. recorded at a higher sample rate
+    unsigned int skip = n > size ? n - size : 0;
+    if (skip != 0)
+      logging_warning( "Burst %li exceeds %u samples, decoding only its start.\n", bursts, size );
+    n -= skip;
+    if (fread( buf, 2, n, in ) != n)
+      break;
+    for (i = 0; (i < skip) && (fgetc( in ) != EOF) && (fgetc( in ) != EOF); i++);
+    if (i < skip)
+      break;
+    // decode in place, the bytes of sample i are never needed again
+    const uint8_t *p = (const uint8_t *)buf;
+    for (i = 0; i < n; i++)
+      buf[i] = (int16_t)(p[2*i] | (p[2*i + 1] << 8));
+    rx.t_detect = rx.t_cut = trace_now();
+    if (bd->begin != 0) {
+      bd->begin( bd, onset );
+      bd->samples( bd, buf, n );
+      bd->end( bd, 1, &rx );
+    } else {
+      bd->input( bd, buf, n, &rx );
+    }
+    bursts++;
+  }
+  if (got != 0)
+    logging_warning( "Burst capture is truncated after %li bursts.\n", bursts );
+  pool_put( pool, buf );
+  return bursts;
+}
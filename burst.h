@@ -0,0 +1,58 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BURST_H
+#define BURST_H 1
+
+/** burst captures: only the transmissions the transmission decoder
+ * cuts out, for archiving and for testing bit and protocol decoders
+ * without the detector. A tee in front of the bit decoder records what
+ * it is given, the replay feeds a capture to any bit decoder.
+ *
+ * The file is appended to, all numbers little endian:
+ *
+ *  header  "RTL868T1", u32 version, u32 sample rate in S/s (16 bytes),
+ *          only at the start of the file
+ *  burst   "BST1", u32 n, u64 number of the first sample, i32 noise
+ *          floor and i32 signal at the end, i32 noise floor at the
+ *          start (28 bytes), then i16 samples[n]
+ */
+
+#include <stdio.h>
+#include "bit_decoder.h"
+
+#define BURST_VERSION 1
+
+/** record the bursts of all tees to filename, sampled at rate. returns 0
+ * on success */
+int burst_record( const char *filename, double rate );
+/// stop recording
+void burst_close( void );
+/** bit decoder recording the transmissions it gets, then handing them on
+ * to next, which it destroys with itself */
+bit_decoder_t *burst_tee_create( bit_decoder_t *next );
+
+/// check the header of the capture in, and get its sample rate
+int burst_open( FILE *in, double *rate );
+/** feed all bursts of in to bd as accepted transmissions, returns the
+ * number of bursts or negative on errors */
+long burst_replay( FILE *in, bit_decoder_t *bd );
+
+#endif
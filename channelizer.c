@@ -0,0 +1,202 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "channelizer.h"
+#include "pipeline.h"
+#include "fm_demod.h"
+#include "spsc.h"
+#include "logging.h"
+
+/// number of IQ blocks queued per channel
+#define CH_QUEUE 32
+/// how long an idle thread sleeps before looking at its queue again
+#define CH_IDLE_NS 1000000
+/// channels must be this much inside the captured band (fraction of the rate)
+#define CH_MARGIN 0.1
+
+typedef struct {
+  size_t n;
+  uint8_t raw[];
+} ch_block_t;
+
+typedef struct {
+  double freq;
+  fm_demod_t fm;
+  spsc_t queue;
+  sample_decoder_t *sd;
+  bit_decoder_t *bd;
+  pthread_t thread;
+  char name[16];
+  int16_t out[PIPELINE_BLOCK];
+} ch_channel_t;
+
+ch_channel_t ch_channels[CH_MAX];
+int ch_n;
+size_t ch_block_len;
+size_t ch_sample_size;
+int ch_lossless;
+stream_decoder_t *ch_next;
+/// serializes the channels' frames into ch_next
+pthread_mutex_t ch_lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int ch_reader_done;
+
+static void ch_idle( void ) {
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = CH_IDLE_NS };
+  nanosleep( &ts, 0 );
+}
+
+int ch_add( double freq ) {
+  if (ch_n >= CH_MAX) {
+    logging_error( "At most %i channels are supported.\n", CH_MAX );
+    return -1;
+  }
+  ch_channels[ch_n++].freq = freq;
+  return 0;
+}
+
+int ch_count( void ) {
+  return ch_n;
+}
+
+int ch_locked_input( stream_decoder_t *self, int tm[], unsigned int length, const rx_info_t *rx ) {
+  pthread_mutex_lock( &ch_lock );
+  int res = ch_next->input( ch_next, tm, length, rx );
+  pthread_mutex_unlock( &ch_lock );
+  return res;
+}
+
+/// stream decoder behind every channel's bit decoder
+stream_decoder_t ch_locked = {
+  .name = "Channel merger",
+  .shorthand = "ch_locked",
+  .init = 0,
+  .input = ch_locked_input
+};
+
+static void *ch_main( void *arg ) {
+  ch_channel_t *ch = arg;
+  while (1) {
+    ch_block_t *b = spsc_pop_slot( &ch->queue );
+    if (b == 0) {
+      if (atomic_load( &ch_reader_done ) && (spsc_depth( &ch->queue ) == 0))
+        break;
+      ch_idle();
+      continue;
+    }
+    size_t n = fm_demod( &ch->fm, b->raw, b->n, ch->out );
+    spsc_pop( &ch->queue );
+    ch->sd->input_block( ch->sd, ch->out, n );
+  }
+  return 0;
+}
+
+int ch_start( int format, unsigned int rate, double center,
+    sample_decoder_t *(*sd_create)( void ), bit_decoder_t *(*bd_create)( void ),
+    stream_decoder_t *next, int lossless ) {
+  int i;
+  if ((next == 0) || (ch_n == 0)) return -1;
+  ch_next = next;
+  ch_lossless = lossless;
+  ch_sample_size = fm_sample_size( format );
+  atomic_init( &ch_reader_done, 0 );
+  for (i = 0; i < ch_n; i++) {
+    ch_channel_t *ch = &ch_channels[i];
+    double offset = ch->freq - center;
+    double limit = (0.5 - CH_MARGIN) * rate;
+    if ((offset < -limit) || (offset > limit)) {
+      logging_error( "Channel %1.0f Hz is outside of %1.0f Hz +- %i S/s.\n", ch->freq, center, rate / 2 );
+      return -1;
+    }
+    if (fm_demod_init( &ch->fm, format, rate, offset, PIPELINE_BLOCK * fm_decimation( rate ) ) != 0)
+      return -1;
+    ch->sd = sd_create();
+    ch->bd = bd_create();
+    if ((ch->sd == 0) || (ch->bd == 0) ||
+        (ch->sd->init( ch->sd, ch->bd ) != 0) || (ch->bd->init( ch->bd, &ch_locked ) != 0))
+      return -1;
+    // all channels use the same decimation
+    ch_block_len = PIPELINE_BLOCK * fm_demod_decimation( &ch->fm );
+    snprintf( ch->name, sizeof(ch->name), "ch%i", i );
+    if (spsc_init( &ch->queue, ch->name, CH_QUEUE, sizeof(ch_block_t) + ch_block_len * ch_sample_size ) != 0)
+      return -1;
+  }
+  for (i = 0; i < ch_n; i++) {
+    if (pthread_create( &ch_channels[i].thread, 0, ch_main, &ch_channels[i] ) != 0) {
+      logging_error( "Could not start channel threads.\n" );
+      return -1;
+    }
+  }
+  logging_info( "Channelizer started with %i channels around %1.0f Hz, %s.\n", ch_n, center,
+    lossless ? "lossless" : "dropping samples on overflow" );
+  return 0;
+}
+
+size_t ch_block_length( void ) {
+  return ch_block_len;
+}
+
+void ch_push( const void *raw, size_t n ) {
+  int i;
+  if (n > ch_block_len) n = ch_block_len;
+  for (i = 0; i < ch_n; i++) {
+    ch_channel_t *ch = &ch_channels[i];
+    ch_block_t *b;
+    while (((b = spsc_push_slot( &ch->queue )) == 0) && ch_lossless)
+      ch_idle();
+    if (b == 0) {
+      spsc_drop( &ch->queue );
+      logging_warning( "Queue of channel %1.0f Hz full, dropping %i samples.\n", ch->freq, (int)n );
+      continue;
+    }
+    b->n = n;
+    memcpy( b->raw, raw, n * ch_sample_size );
+    spsc_push( &ch->queue );
+  }
+}
+
+void ch_stop( void ) {
+  int i;
+  atomic_store( &ch_reader_done, 1 );
+  for (i = 0; i < ch_n; i++) {
+    ch_channel_t *ch = &ch_channels[i];
+    pthread_join( ch->thread, 0 );
+    logging_info( "Channel %1.0f Hz stopped, queue %s: %lu pushed, %lu dropped, max %u.\n", ch->freq,
+      ch->queue.name, atomic_load( &ch->queue.pushed ), atomic_load( &ch->queue.drops ), atomic_load( &ch->queue.max_depth ) );
+    spsc_free( &ch->queue );
+    fm_demod_free( &ch->fm );
+    ch->sd->destroy( ch->sd );
+    ch->bd->destroy( ch->bd );
+  }
+}
+
+void ch_status( void ) {
+  char s[CH_MAX * 32];
+  int i, l = 0;
+  s[0] = 0;
+  for (i = 0; i < ch_n; i++)
+    l += snprintf( s + l, sizeof(s) - l, "%s%s=%u/%u d=%lu", i ? " " : "", ch_channels[i].name,
+      spsc_depth( &ch_channels[i].queue ), atomic_load( &ch_channels[i].queue.max_depth ), atomic_load( &ch_channels[i].queue.drops ) );
+  logging_status( 4, "%s", s );
+}
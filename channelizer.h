@@ -0,0 +1,58 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef CHANNELIZER_H
+#define CHANNELIZER_H 1
+
+/** wideband mode: one IQ capture holds several channels. Every channel
+ * is mixed to 0 Hz, filtered, decimated and demodulated on its own
+ * thread, which also runs the channel's sample and bit decoder. Frames of all
+ * channels go to one stream decoder, one at a time.
+ */
+
+#include <stddef.h>
+#include "sample_decoder.h"
+#include "bit_decoder.h"
+
+/// maximum number of channels
+#define CH_MAX 8
+
+/// add a channel at freq Hz, before ch_start()
+int ch_add( double freq );
+/// number of channels added
+int ch_count( void );
+/** start one thread per channel for IQ samples of format at rate,
+ * tuned to center Hz. Every channel gets a sample and a bit decoder
+ * from sd_create and bd_create, see pipeline_start() for next and
+ * lossless.
+ */
+int ch_start( int format, unsigned int rate, double center,
+  sample_decoder_t *(*sd_create)( void ), bit_decoder_t *(*bd_create)( void ),
+  stream_decoder_t *next, int lossless );
+/// number of IQ samples to be passed to ch_push() at once at most
+size_t ch_block_length( void );
+/// hand n IQ samples to every channel
+void ch_push( const void *raw, size_t n );
+/// process everything queued so far and stop the threads
+void ch_stop( void );
+/// put queue depths and drop counters into the status line
+void ch_status( void );
+
+#endif
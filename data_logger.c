@@ -20,49 +20,78 @@
 
 #include "logging.h"
 #include "data_logger.h"
+#include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 
-/// time at start of program
-time_t dl_file_start;
+/* state of one file logger */
+typedef struct {
+  /// time at start of program
+  time_t start;
+  /// file to write to
+  FILE *out;
+} dl_file_ctx_t;
 
-/// file to write to
-FILE *dl_file_out;
-
-int dl_file_init( FILE *out ) {
-  time( &dl_file_start );
-  dl_file_out = out;
+int dl_file_init( data_logger_t *self, FILE *out ) {
+  dl_file_ctx_t *c = self->ctx;
+  time( &c->start );
+  c->out = out;
   logging_info( "Data_Logger initialized.\n" );
+  return 0;
 }
 
-int dl_file_input(int sensor_id, float temp, float rel_hum, int flags) {
+int dl_file_input(data_logger_t *self, const dl_record_t *r) {
+  dl_file_ctx_t *c = self->ctx;
+  int sensor_id = r->sensor_id, flags = r->flags;
+  float temp = r->temp, rel_hum = r->rel_hum;
   /* output into octave readable file */
   /* decorate with timestamp and seconds since start of program */
   
-  time_t cur_time;
+  time_t cur_time = r->time / 1000000000;
   struct tm ts;
-  if ((time( &cur_time ) == 0) || (localtime_r(&cur_time, &ts) == 0)) {
+  if (localtime_r(&cur_time, &ts) == 0) {
     logging_error( "Could not get current time.\n" );
     ts.tm_year = 0; ts.tm_mon = 0; ts.tm_mday = 0;
     ts.tm_hour = 0; ts.tm_min = 0; ts.tm_sec = 0;
   } 
-  double time_sec = difftime( cur_time, dl_file_start );
+  double time_sec = difftime( cur_time, c->start );
 
   logging_info( "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, %1.2f, %i.\n", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)cur_time, sensor_id, temp, rel_hum, flags );
   if (rel_hum == 106) {
-    fprintf( dl_file_out, "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, nan, %i.\n", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)cur_time, sensor_id, temp, flags );
+    fprintf( c->out, "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, nan, %i", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)cur_time, sensor_id, temp, flags );
   } else {
-    fprintf( dl_file_out, "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, %1.2f, %i.\n", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)cur_time, sensor_id, temp, rel_hum, flags );
+    fprintf( c->out, "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, %1.2f, %i", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday, ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)cur_time, sensor_id, temp, rel_hum, flags );
   }
-  fflush( dl_file_out );
-  
+  // the copies are a column of their own only if they were counted
+  if (r->confidence > 0)
+    fprintf( c->out, ", %i.\n", r->confidence );
+  else
+    fprintf( c->out, ".\n" );
   logging_status( 3, "%i -> %1.1f°C, %1.1f%%", sensor_id, temp, rel_hum );
   return 0; // ok :-)
 }
 
-data_logger_t dl_file = {
-  .name = "DataLogger writing to file",
-  .shorthand = "dl_file",
-  .init = dl_file_init,
-  .input = dl_file_input,
-};
+void dl_file_destroy(data_logger_t *self) {
+  free( self->ctx );
+  free( self );
+}
+
+data_logger_t *dl_file_create(void) {
+  data_logger_t *self = malloc( sizeof(*self) );
+  dl_file_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a data logger.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (data_logger_t){
+    .name = "DataLogger writing to file",
+    .shorthand = "dl_file",
+    .ctx = c,
+    .init = dl_file_init,
+    .input = dl_file_input,
+    .destroy = dl_file_destroy
+  };
+  return self;
+}
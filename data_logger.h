@@ -23,17 +23,44 @@
 #define DATA_LOGGER_H 1
 
 #include <stdio.h>
+#include "rx_info.h"
 
-/* interface for bit decoder */
+/// protocols, as stored in binary logs
+enum { DL_UNKNOWN = 0, DL_WS300 = 1, DL_TX29 = 2 };
+
+/** one decoded reading */
 typedef struct {
+  long long time; ///< ns since the epoch when the transmission started
+  int protocol;   ///< DL_WS300, ...
+  int sensor_id;
+  float temp;
+  float rel_hum;  ///< 106 if the sensor has no humidity
+  int flags;
+  int confidence; ///< copies received, 0 if not counted (see dedup.h)
+  rx_info_t rx;
+} dl_record_t;
+
+/* interface for data logger, instances work like sample decoders */
+typedef struct data_logger data_logger_t;
+struct data_logger {
   char *name;
   char *shorthand;
+  void *ctx;  ///< state of this instance
   // interface
-  int (*init)(FILE *out);
-  int (*input)(int sensor_id, float temp, float rel_hum, int flags);
-} data_logger_t;
+  int (*init)(data_logger_t *self, FILE *out);
+  int (*input)(data_logger_t *self, const dl_record_t *r);
+  // optional: write out what is buffered
+  int (*flush)(data_logger_t *self);
+  // optional: called about once a second, to write out what is due even
+  // if no record comes
+  void (*tick)(data_logger_t *self);
+  void (*destroy)(data_logger_t *self);
+};
 
-extern data_logger_t dl_file;
+/// logger writing one line per record to a file, flushed by its caller
+data_logger_t *dl_file_create( void );
+/// logger writing blocks of binary records, see dl_bin.h
+data_logger_t *dl_bin_create( void );
 
 
 
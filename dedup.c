@@ -0,0 +1,185 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "logging.h"
+#include "dedup.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+/* one sensor */
+typedef struct {
+  int used;
+  /// rec is still to be handed on
+  int pending;
+  /// its last reading, with the time of the first copy and the copies seen
+  dl_record_t rec;
+} dedup_slot_t;
+
+/* state of one dedup logger */
+typedef struct {
+  data_logger_t *inner;
+  /// in ns
+  long long window;
+  dedup_slot_t slot[DEDUP_SLOTS];
+  /// input and tick may run in different threads
+  pthread_mutex_t lock;
+} dedup_ctx_t;
+
+static metric_t *dd_duplicates = 0;
+
+static unsigned int dd_hash( int protocol, int sensor_id ) {
+  uint32_t k = ((uint32_t)protocol << 24) ^ (uint32_t)sensor_id;
+  return ((k * 2654435761u) >> 16) & (DEDUP_SLOTS - 1);
+}
+
+static int dd_same( const dl_record_t *a, const dl_record_t *b ) {
+  return (a->temp == b->temp) && (a->rel_hum == b->rel_hum) && (a->flags == b->flags);
+}
+
+/** hand on the pending records whose window has passed at now, oldest
+ * first */
+static int dd_expire( dedup_ctx_t *c, long long now ) {
+  int res = 0;
+  unsigned int i;
+  while (1) {
+    dedup_slot_t *first = 0;
+    for (i = 0; i < DEDUP_SLOTS; i++) {
+      dedup_slot_t *s = &c->slot[i];
+      if (s->pending && (s->rec.time <= now - c->window) &&
+          ((first == 0) || (s->rec.time < first->rec.time)))
+        first = s;
+    }
+    if (first == 0)
+      return res;
+    first->pending = 0;
+    if (c->inner->input( c->inner, &first->rec ) != 0)
+      res = -1;
+  }
+}
+
+/** the slot of the sensor of r. If it is not in the table, an empty slot
+ * or one whose reading is handed on and out of the window, 0 if there is
+ * none */
+static dedup_slot_t *dd_find( dedup_ctx_t *c, const dl_record_t *r ) {
+  unsigned int i, h = dd_hash( r->protocol, r->sensor_id );
+  dedup_slot_t *stale = 0;
+  for (i = 0; i < DEDUP_SLOTS; i++) {
+    dedup_slot_t *s = &c->slot[(h + i) & (DEDUP_SLOTS - 1)];
+    if (!s->used)
+      return stale != 0 ? stale : s;
+    if ((s->rec.protocol == r->protocol) && (s->rec.sensor_id == r->sensor_id))
+      return s;
+    // slots are reused, not emptied, so the probe sequences stay intact
+    if ((stale == 0) && !s->pending && (s->rec.time < r->time - c->window))
+      stale = s;
+  }
+  return stale;
+}
+
+int dedup_init( data_logger_t *self, FILE *out ) {
+  dedup_ctx_t *c = self->ctx;
+  logging_info( "Dropping repeated records within %1.1f s.\n", c->window * 1e-9 );
+  return 0;
+}
+
+int dedup_input( data_logger_t *self, const dl_record_t *r ) {
+  dedup_ctx_t *c = self->ctx;
+  pthread_mutex_lock( &c->lock );
+  int res = dd_expire( c, r->time );
+  dedup_slot_t *s = dd_find( c, r );
+  if (s == 0) {
+    // all sensors sent within the window, do without
+    logging_verbose( "Duplicate table is full, passing on %i.\n", r->sensor_id );
+    dl_record_t rec = *r;
+    rec.confidence = 1;
+    if (c->inner->input( c->inner, &rec ) != 0)
+      res = -1;
+  } else if (s->used && (s->rec.protocol == r->protocol) && (s->rec.sensor_id == r->sensor_id) &&
+             dd_same( &s->rec, r ) && (r->time - s->rec.time <= c->window)) {
+    // a copy, late ones only count as dropped
+    if (s->pending)
+      s->rec.confidence++;
+    metrics_add( dd_duplicates, 1 );
+    logging_verbose( "Dropped a copy of %i.\n", r->sensor_id );
+  } else {
+    if (s->pending && (s->rec.protocol == r->protocol) && (s->rec.sensor_id == r->sensor_id) &&
+        (c->inner->input( c->inner, &s->rec ) != 0))
+      res = -1;
+    s->used = 1;
+    s->pending = 1;
+    s->rec = *r;
+    s->rec.confidence = 1;
+  }
+  pthread_mutex_unlock( &c->lock );
+  return res;
+}
+
+int dedup_flush( data_logger_t *self ) {
+  dedup_ctx_t *c = self->ctx;
+  pthread_mutex_lock( &c->lock );
+  int res = dd_expire( c, LLONG_MAX );
+  pthread_mutex_unlock( &c->lock );
+  if ((c->inner->flush != 0) && (c->inner->flush( c->inner ) != 0))
+    res = -1;
+  return res;
+}
+
+void dedup_tick( data_logger_t *self, long long now ) {
+  dedup_ctx_t *c = self->ctx;
+  pthread_mutex_lock( &c->lock );
+  dd_expire( c, now );
+  pthread_mutex_unlock( &c->lock );
+}
+
+void dedup_destroy( data_logger_t *self ) {
+  dedup_ctx_t *c = self->ctx;
+  dd_expire( c, LLONG_MAX );
+  pthread_mutex_destroy( &c->lock );
+  free( c );
+  free( self );
+}
+
+data_logger_t *dedup_create( data_logger_t *inner, double window ) {
+  data_logger_t *self = malloc( sizeof(*self) );
+  dedup_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a duplicate filter.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  c->inner = inner;
+  c->window = (long long)(window * 1e9);
+  pthread_mutex_init( &c->lock, 0 );
+  dd_duplicates = metrics_counter( "rtl868_duplicates_total", "Repeated records dropped by the duplicate filter." );
+  *self = (data_logger_t){
+    .name = "Duplicate filter",
+    .shorthand = "dedup",
+    .ctx = c,
+    .init = dedup_init,
+    .input = dedup_input,
+    .flush = dedup_flush,
+    .destroy = dedup_destroy
+  };
+  return self;
+}
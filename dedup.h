@@ -0,0 +1,47 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEDUP_H
+#define DEDUP_H 1
+
+/** duplicate suppression. Sensors send every reading several times, the
+ * dedup logger passes on only the first copy. Copies of a reading (same
+ * protocol, sensor and payload) within the window after the first one are
+ * dropped and counted in its confidence, so a record is handed on once its
+ * window has passed, a different reading of the sensor arrives or the
+ * logger is flushed.
+ *
+ * Sensors are kept in a small open addressing table keyed by protocol and
+ * sensor id, together with their last reading and its time.
+ */
+
+#include "data_logger.h"
+
+/// sensors tracked at a time, a power of 2
+#define DEDUP_SLOTS 64
+
+/** data logger dropping repeated records within window seconds and handing
+ * the others on to inner, which must live as long */
+data_logger_t *dedup_create( data_logger_t *inner, double window );
+/** hand on the records whose window has passed at now (ns since the
+ * epoch). Unlike input, this may be called from another thread. */
+void dedup_tick( data_logger_t *self, long long now );
+
+#endif
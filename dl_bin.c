@@ -0,0 +1,353 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "logging.h"
+#include "data_logger.h"
+#include "dl_bin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/// a partly filled block is written after this many seconds
+#define DL_BIN_FLUSH 60
+#define DL_BIN_HEADER 16
+#define DL_BIN_BLOCK_HEADER 24
+#define DL_BIN_INDEX_ENTRY 32
+
+/* little endian encoding */
+
+static uint8_t *dl_put16( uint8_t *p, uint16_t v ) {
+  p[0] = v; p[1] = v >> 8;
+  return p + 2;
+}
+static uint8_t *dl_put32( uint8_t *p, uint32_t v ) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+  return p + 4;
+}
+static uint8_t *dl_put64( uint8_t *p, uint64_t v ) {
+  p = dl_put32( p, (uint32_t)v );
+  return dl_put32( p, (uint32_t)(v >> 32) );
+}
+static uint8_t *dl_putf( uint8_t *p, float f ) {
+  uint32_t v;
+  memcpy( &v, &f, sizeof(v) );
+  return dl_put32( p, v );
+}
+static uint16_t dl_get16( const uint8_t *p ) {
+  return p[0] | (p[1] << 8);
+}
+static uint32_t dl_get32( const uint8_t *p ) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint64_t dl_get64( const uint8_t *p ) {
+  return dl_get32( p ) | ((uint64_t)dl_get32( p + 4 ) << 32);
+}
+static float dl_getf( const uint8_t *p ) {
+  uint32_t v = dl_get32( p );
+  float f;
+  memcpy( &f, &v, sizeof(f) );
+  return f;
+}
+
+/* writer */
+
+typedef struct {
+  uint64_t offset;
+  int64_t first, last;
+  uint32_t n;
+} dl_bin_index_t;
+
+/* state of one binary logger */
+typedef struct {
+  FILE *out;
+  /// file offset of the next write
+  uint64_t offset;
+  /// records of the current block
+  dl_record_t rec[DL_BIN_BLOCK];
+  unsigned int n;
+  /// monotonic time of the first record in the block
+  time_t opened;
+  /// index of the blocks written
+  dl_bin_index_t *index;
+  size_t n_index, len_index;
+  uint8_t buf[DL_BIN_BLOCK_HEADER + DL_BIN_BLOCK * DL_BIN_RECORD];
+} dl_bin_ctx_t;
+
+static time_t dl_bin_monotonic( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec;
+}
+
+static int dl_bin_write( dl_bin_ctx_t *c, const uint8_t *buf, size_t n ) {
+  if (fwrite( buf, 1, n, c->out ) != n) {
+    logging_error( "Could not write the binary log.\n" );
+    return -1;
+  }
+  c->offset += n;
+  return 0;
+}
+
+/** write the current block, as columns */
+static int dl_bin_write_block( dl_bin_ctx_t *c ) {
+  unsigned int i, n = c->n;
+  if (n == 0) return 0;
+  if (c->n_index >= c->len_index) {
+    size_t len = c->len_index ? 2 * c->len_index : 64;
+    dl_bin_index_t *index = realloc( c->index, len * sizeof(index[0]) );
+    if (index == 0) {
+      logging_error( "Could not allocate the binary log index.\n" );
+      return -1;
+    }
+    c->index = index;
+    c->len_index = len;
+  }
+  // the clock may have been set back, so look at all of them
+  int64_t first = c->rec[0].time, last = c->rec[0].time;
+  for (i = 1; i < n; i++) {
+    if (c->rec[i].time < first) first = c->rec[i].time;
+    if (c->rec[i].time > last) last = c->rec[i].time;
+  }
+  c->index[c->n_index++] = (dl_bin_index_t){ c->offset, first, last, n };
+  uint8_t *p = c->buf;
+  memcpy( p, "BLK2", 4 );
+  p = dl_put32( p + 4, n );
+  p = dl_put64( p, first );
+  p = dl_put64( p, last );
+  for (i = 0; i < n; i++) p = dl_put64( p, c->rec[i].time );
+  for (i = 0; i < n; i++) p = dl_put32( p, c->rec[i].sensor_id );
+  for (i = 0; i < n; i++) p = dl_putf( p, c->rec[i].temp );
+  for (i = 0; i < n; i++) p = dl_putf( p, c->rec[i].rel_hum == 106 ? NAN : c->rec[i].rel_hum );
+  for (i = 0; i < n; i++) p = dl_put16( p, c->rec[i].flags );
+  for (i = 0; i < n; i++) *p++ = c->rec[i].protocol;
+  for (i = 0; i < n; i++) p = dl_put32( p, c->rec[i].rx.noise );
+  for (i = 0; i < n; i++) p = dl_put32( p, c->rec[i].rx.signal );
+  for (i = 0; i < n; i++) *p++ = c->rec[i].confidence > 255 ? 255 : c->rec[i].confidence;
+  c->n = 0;
+  if (dl_bin_write( c, c->buf, p - c->buf ) != 0)
+    return -1;
+  fflush( c->out );
+  logging_verbose( "Wrote a binary log block of %u records.\n", n );
+  return 0;
+}
+
+int dl_bin_init( data_logger_t *self, FILE *out ) {
+  dl_bin_ctx_t *c = self->ctx;
+  struct stat st;
+  c->out = out;
+  c->offset = 0;
+  // files appended to already have their header
+  if ((fstat( fileno( out ), &st ) == 0) && S_ISREG( st.st_mode ) && (st.st_size > 0)) {
+    c->offset = st.st_size;
+  } else {
+    uint8_t h[DL_BIN_HEADER];
+    memcpy( h, "RTL868B1", 8 );
+    dl_put32( dl_put32( h + 8, DL_BIN_VERSION ), DL_BIN_BLOCK );
+    if (dl_bin_write( c, h, sizeof(h) ) != 0)
+      return -1;
+  }
+  logging_info( "Binary data logger initialized.\n" );
+  return 0;
+}
+
+int dl_bin_input( data_logger_t *self, const dl_record_t *r ) {
+  dl_bin_ctx_t *c = self->ctx;
+  if (c->n == 0)
+    c->opened = dl_bin_monotonic();
+  c->rec[c->n++] = *r;
+  logging_info( "%lli, %i, %1.2f, %1.2f, %i.\n", (long long int)(r->time / 1000000000), r->sensor_id, r->temp, r->rel_hum, r->flags );
+  logging_status( 3, "%i -> %1.1f°C, %1.1f%%", r->sensor_id, r->temp, r->rel_hum );
+  if ((c->n >= DL_BIN_BLOCK) || (dl_bin_monotonic() - c->opened >= DL_BIN_FLUSH))
+    return dl_bin_write_block( c );
+  return 0;
+}
+
+int dl_bin_flush( data_logger_t *self ) {
+  return dl_bin_write_block( self->ctx );
+}
+
+void dl_bin_tick( data_logger_t *self ) {
+  dl_bin_ctx_t *c = self->ctx;
+  if ((c->n > 0) && (dl_bin_monotonic() - c->opened >= DL_BIN_FLUSH))
+    dl_bin_write_block( c );
+}
+
+void dl_bin_destroy( data_logger_t *self ) {
+  dl_bin_ctx_t *c = self->ctx;
+  if ((c->out != 0) && (dl_bin_write_block( c ) == 0) && (c->n_index > 0)) {
+    /* the index of this run */
+    size_t i;
+    uint64_t at = c->offset;
+    uint8_t e[DL_BIN_INDEX_ENTRY];
+    memcpy( e, "IDX1", 4 );
+    dl_put32( e + 4, c->n_index );
+    int res = dl_bin_write( c, e, 8 );
+    for (i = 0; (res == 0) && (i < c->n_index); i++) {
+      uint8_t *p = dl_put64( e, c->index[i].offset );
+      p = dl_put64( p, c->index[i].first );
+      p = dl_put64( p, c->index[i].last );
+      dl_put32( dl_put32( p, c->index[i].n ), 0 );
+      res = dl_bin_write( c, e, sizeof(e) );
+    }
+    if (res == 0) {
+      memcpy( dl_put64( e, at ), "END1", 4 );
+      dl_put32( e + 12, 0 );
+      dl_bin_write( c, e, 16 );
+    }
+    fflush( c->out );
+  }
+  free( c->index );
+  free( c );
+  free( self );
+}
+
+data_logger_t *dl_bin_create( void ) {
+  data_logger_t *self = malloc( sizeof(*self) );
+  dl_bin_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a data logger.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (data_logger_t){
+    .name = "DataLogger writing binary blocks",
+    .shorthand = "dl_bin",
+    .ctx = c,
+    .init = dl_bin_init,
+    .input = dl_bin_input,
+    .flush = dl_bin_flush,
+    .tick = dl_bin_tick,
+    .destroy = dl_bin_destroy
+  };
+  return self;
+}
+
+/* reader */
+
+int dl_bin_open( dl_bin_reader_t *r, FILE *in ) {
+  uint8_t h[DL_BIN_HEADER];
+  memset( r, 0, sizeof(*r) );
+  r->in = in;
+  r->from = INT64_MIN;
+  r->to = INT64_MAX;
+  if ((fread( h, 1, sizeof(h), in ) != sizeof(h)) || (memcmp( h, "RTL868B1", 8 ) != 0)) {
+    logging_error( "Not a binary rtl_868 log.\n" );
+    return -1;
+  }
+  if ((dl_get32( h + 8 ) != DL_BIN_VERSION) || (dl_get32( h + 12 ) > DL_BIN_BLOCK)) {
+    logging_error( "Unsupported binary log version %u.\n", dl_get32( h + 8 ) );
+    return -1;
+  }
+  return 0;
+}
+
+int dl_bin_section( dl_bin_reader_t *r, uint32_t *n, int64_t *first, int64_t *last ) {
+  uint8_t h[DL_BIN_BLOCK_HEADER];
+  size_t got = fread( h, 1, 8, r->in );
+  if (got == 0) return 0;
+  if (got != 8) goto truncated;
+  *n = dl_get32( h + 4 );
+  if (memcmp( h, "IDX1", 4 ) == 0)
+    return 2;
+  if (memcmp( h, "BLK2", 4 ) == 0)
+    r->record = DL_BIN_RECORD;
+  else if (memcmp( h, "BLK1", 4 ) == 0)
+    r->record = DL_BIN_RECORD1;
+  else
+    r->record = 0;
+  if ((r->record == 0) || (*n > DL_BIN_BLOCK)) {
+    logging_error( "Invalid section in the binary log.\n" );
+    return -1;
+  }
+  if (fread( h + 8, 1, 16, r->in ) != 16) goto truncated;
+  *first = dl_get64( h + 8 );
+  *last = dl_get64( h + 16 );
+  return 1;
+truncated:
+  // e.g. the logger was killed while writing
+  logging_warning( "Binary log is truncated.\n" );
+  return 0;
+}
+
+int dl_bin_skip( dl_bin_reader_t *r, int type, uint32_t n ) {
+  long len = type == 1 ? (long)n * r->record : (long)n * DL_BIN_INDEX_ENTRY + 16;
+  if (fseek( r->in, len, SEEK_CUR ) == 0)
+    return 0;
+  // pipes cannot seek
+  uint8_t buf[1024];
+  while (len > 0) {
+    size_t got = fread( buf, 1, len < (long)sizeof(buf) ? len : sizeof(buf), r->in );
+    if (got == 0) return -1;
+    len -= got;
+  }
+  return 0;
+}
+
+/** read the contents of a block of n records */
+static int dl_bin_block( dl_bin_reader_t *r, uint32_t n ) {
+  uint8_t buf[DL_BIN_BLOCK * DL_BIN_RECORD];
+  uint32_t i;
+  if (fread( buf, r->record, n, r->in ) != n) {
+    logging_warning( "Binary log is truncated.\n" );
+    return -1;
+  }
+  const uint8_t *p = buf;
+  for (i = 0; i < n; i++, p += 8) r->rec[i].time = r->time[i] = dl_get64( p );
+  for (i = 0; i < n; i++, p += 4) r->rec[i].sensor_id = (int32_t)dl_get32( p );
+  for (i = 0; i < n; i++, p += 4) r->rec[i].temp = dl_getf( p );
+  for (i = 0; i < n; i++, p += 4) r->rec[i].rel_hum = dl_getf( p );
+  for (i = 0; i < n; i++, p += 2) r->rec[i].flags = dl_get16( p );
+  for (i = 0; i < n; i++, p += 1) r->rec[i].protocol = *p;
+  for (i = 0; i < n; i++, p += 4) r->rec[i].rx.noise = (int32_t)dl_get32( p );
+  for (i = 0; i < n; i++, p += 4) r->rec[i].rx.signal = (int32_t)dl_get32( p );
+  for (i = 0; i < n; i++) r->rec[i].confidence = r->record == DL_BIN_RECORD ? p[i] : 0;
+  for (i = 0; i < n; i++)
+    if (isnan( r->rec[i].rel_hum )) r->rec[i].rel_hum = 106;
+  r->n = n;
+  r->i = 0;
+  return 0;
+}
+
+int dl_bin_next( dl_bin_reader_t *r, int64_t *time, dl_record_t *rec ) {
+  while (1) {
+    for (; r->i < r->n; r->i++) {
+      if ((r->time[r->i] >= r->from) && (r->time[r->i] <= r->to)) {
+        *time = r->time[r->i];
+        *rec = r->rec[r->i++];
+        return 1;
+      }
+    }
+    uint32_t n;
+    int64_t first, last;
+    int type = dl_bin_section( r, &n, &first, &last );
+    if (type <= 0)
+      return type;
+    if ((type == 2) || (last < r->from) || (first > r->to)) {
+      if (dl_bin_skip( r, type, n ) != 0)
+        return -1;
+    } else if (dl_bin_block( r, n ) != 0) {
+      return 0;
+    }
+  }
+}
@@ -0,0 +1,79 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DL_BIN_H
+#define DL_BIN_H 1
+
+/** binary log format of dl_bin, all numbers little endian:
+ *
+ *  header  "RTL868B1", u32 version, u32 records per block (16 bytes),
+ *          only at the start of the file
+ *  block   "BLK2", u32 n, i64 earliest and i64 latest time in ns since
+ *          the epoch (24 bytes), then the columns of the n records one after
+ *          the other: i64 time[n], i32 sensor_id[n], f32 temp[n],
+ *          f32 rel_hum[n] (nan without humidity), u16 flags[n],
+ *          u8 protocol[n], i32 noise[n], i32 signal[n], u8 confidence[n].
+ *          "BLK1" blocks of older loggers lack the confidence column.
+ *  index   "IDX1", u32 n, then per block of the run u64 file offset,
+ *          i64 earliest, i64 latest time, u32 records, u32 0; followed by
+ *          u64 offset of "IDX1", "END1" and u32 0 (16 bytes)
+ *
+ * Every run of the logger appends blocks and, when it ends normally,
+ * its index. Readers can skip blocks by their header alone.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "data_logger.h"
+
+#define DL_BIN_VERSION 1
+/// records per block
+#define DL_BIN_BLOCK 256
+/// bytes per record in a block
+#define DL_BIN_RECORD 32
+/// bytes per record in a "BLK1" block
+#define DL_BIN_RECORD1 31
+
+/* sequential reader */
+typedef struct {
+  FILE *in;
+  /// only records in [from, to] are returned
+  int64_t from, to;
+  /// the current block
+  int64_t time[DL_BIN_BLOCK];
+  dl_record_t rec[DL_BIN_BLOCK];
+  unsigned int n, i;
+  /// bytes per record of the block whose header was read last
+  unsigned int record;
+} dl_bin_reader_t;
+
+/// check the header of in, returns 0 on success
+int dl_bin_open( dl_bin_reader_t *r, FILE *in );
+/** next record and its time in ns, returns 1 for a record, 0 at the end
+ * of the file and negative on errors */
+int dl_bin_next( dl_bin_reader_t *r, int64_t *time, dl_record_t *rec );
+/** read the header of the next block or index at the current position
+ * without its contents. returns 1 for a block, 2 for an index (n is
+ * its number of entries), 0 at the end, negative on errors */
+int dl_bin_section( dl_bin_reader_t *r, uint32_t *n, int64_t *first, int64_t *last );
+/// skip the contents of the section just read by dl_bin_section()
+int dl_bin_skip( dl_bin_reader_t *r, int type, uint32_t n );
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/** rtl_868_dump: export binary logs written by rtl_868 -O bin as the
+ * text format of the default data logger */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "dl_bin.h"
+#include "logging.h"
+
+static const char *dump_protocol( int protocol ) {
+  switch (protocol) {
+    case DL_WS300: return "ws300";
+    case DL_TX29: return "tx29";
+    default: return "unknown";
+  }
+}
+
+/** print the sections of the file, no records */
+static int dump_list( dl_bin_reader_t *r ) {
+  uint32_t n;
+  int64_t first = 0, last = 0;
+  int type;
+  unsigned long blocks = 0, records = 0;
+  // offset of the section, counted as the input may be a pipe
+  unsigned long long at = 16;
+  while ((type = dl_bin_section( r, &n, &first, &last )) > 0) {
+    if (type == 1) {
+      printf( "%10llu block, %3u records, %lli.%03lli - %lli.%03lli\n", at, n,
+        (long long)(first / 1000000000), (long long)(first / 1000000 % 1000),
+        (long long)(last / 1000000000), (long long)(last / 1000000 % 1000) );
+      blocks++;
+      records += n;
+    } else {
+      printf( "%10llu index of %u blocks\n", at, n );
+    }
+    at += type == 1 ? 24 + (unsigned long long)n * r->record : 8 + (unsigned long long)n * 32 + 16;
+    if (dl_bin_skip( r, type, n ) != 0)
+      return 1;
+  }
+  printf( "%lu blocks, %lu records.\n", blocks, records );
+  return type < 0;
+}
+
+int main( int argc, char **argv ) {
+  dl_bin_reader_t r;
+  int64_t from = INT64_MIN, to = INT64_MAX;
+  int extended = 0, list = 0;
+  int c;
+
+  logging_init();
+  verbose = 1;
+  while ((c = getopt( argc, argv, "s:e:xlq" )) != -1)
+    switch (c) {
+      case 's': from = (int64_t)atoll( optarg ) * 1000000000; break;
+      case 'e': to = (int64_t)atoll( optarg ) * 1000000000 + 999999999; break;
+      case 'x': extended = 1; break;
+      case 'l': list = 1; break;
+      case 'q': verbose--; break;
+      default:
+        fprintf( stderr,
+          "Usage: rtl_868_dump [PARAMETERS] [FILENAME]\n"
+          "   reads the binary log from FILENAME or stdin and writes the records\n"
+          "   in the text format of rtl_868 to stdout.\n"
+          "      -s time     only records at or after time (seconds since the epoch).\n"
+          "      -e time     only records up to time.\n"
+          "      -x          append protocol, noise floor, signal, SNR in dB and the\n"
+          "                  copies received (0 if they were not counted).\n"
+          "      -l          list the blocks instead of the records.\n"
+          "      -q          be less verbose.\n" );
+        return 1;
+    }
+  FILE *in = stdin;
+  if (optind < argc) {
+    in = fopen( argv[optind], "rb" );
+    if (in == 0) {
+      logging_error( "Could not open input file '%s'.\n", argv[optind] );
+      return 1;
+    }
+  }
+  if (dl_bin_open( &r, in ) != 0)
+    return 1;
+  if (list)
+    return dump_list( &r );
+  r.from = from;
+  r.to = to;
+
+  int64_t t;
+  dl_record_t rec;
+  int res;
+  while ((res = dl_bin_next( &r, &t, &rec )) > 0) {
+    time_t sec = t / 1000000000;
+    struct tm ts;
+    localtime_r( &sec, &ts );
+    printf( "%04i-%02i-%02i %02i:%02i:%02i, %lli, %i, %1.2f, ", ts.tm_year+1900, ts.tm_mon+1, ts.tm_mday,
+      ts.tm_hour, ts.tm_min, ts.tm_sec, (long long int)sec, rec.sensor_id, rec.temp );
+    if (rec.rel_hum == 106)
+      printf( "nan, " );
+    else
+      printf( "%1.2f, ", rec.rel_hum );
+    if (extended) {
+      double snr = (rec.rx.noise > 0) && (rec.rx.signal > 0) ? 20 * log10( (double)rec.rx.signal / rec.rx.noise ) : 0;
+      printf( "%i, %s, %i, %i, %1.1f, %i.\n", rec.flags, dump_protocol( rec.protocol ), rec.rx.noise, rec.rx.signal, snr, rec.confidence );
+    } else {
+      printf( "%i.\n", rec.flags );
+    }
+  }
+  fclose( in );
+  return res < 0;
+}
@@ -0,0 +1,237 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fm_demod.h"
+#include "logging.h"
+
+/// taps of the low pass in front of the discriminator per unit of decimation
+#define FM_TAPS_PER_DECIMATION 8
+/// cutoff of that low pass relative to the decimated Nyquist rate
+#define FM_CUTOFF 0.8
+
+int fm_decim_init( fm_decim_t *d, unsigned int decimation, unsigned int taps, float cutoff ) {
+  unsigned int i;
+  if ((decimation == 0) || (taps == 0)) return -1;
+  d->decimation = decimation;
+  d->taps = taps;
+  d->pos = 0;
+  d->phase = 0;
+  d->h = malloc( taps * sizeof(d->h[0]) );
+  d->hist = calloc( 4 * taps, sizeof(d->hist[0]) );
+  if ((d->h == 0) || (d->hist == 0)) {
+    logging_error( "Could not allocate a %i taps filter.\n", taps );
+    fm_decim_free( d );
+    return -1;
+  }
+  // windowed sinc (Hamming), normalized to unity gain at DC
+  float sum = 0;
+  for (i = 0; i < taps; i++) {
+    float x = i - (taps - 1) / 2.0;
+    float s = x == 0 ? 2 * cutoff : sinf( 2 * M_PI * cutoff * x ) / (M_PI * x);
+    float w = taps > 1 ? 0.54 - 0.46 * cosf( 2 * M_PI * i / (taps - 1) ) : 1;
+    d->h[i] = s * w;
+    sum += d->h[i];
+  }
+  for (i = 0; i < taps; i++)
+    d->h[i] /= sum;
+  return 0;
+}
+
+void fm_decim_free( fm_decim_t *d ) {
+  free( d->h );
+  free( d->hist );
+  d->h = 0;
+  d->hist = 0;
+}
+
+size_t fm_decim( fm_decim_t *d, const float in[], size_t n, float out[] ) {
+  size_t i, o = 0;
+  unsigned int k;
+  for (i = 0; i < n; i++) {
+    // store twice, so the last taps samples are always contiguous
+    float *h0 = &d->hist[2 * d->pos];
+    float *h1 = &d->hist[2 * (d->pos + d->taps)];
+    h0[0] = h1[0] = in[2*i];
+    h0[1] = h1[1] = in[2*i+1];
+    d->pos++;
+    if (d->pos >= d->taps) d->pos = 0;
+    if (++d->phase < d->decimation) continue;
+    d->phase = 0;
+    // oldest sample first
+    const float *x = &d->hist[2 * d->pos];
+    float si = 0, sq = 0;
+    for (k = 0; k < d->taps; k++) {
+      si += d->h[k] * x[2*k];
+      sq += d->h[k] * x[2*k+1];
+    }
+    out[2*o] = si;
+    out[2*o+1] = sq;
+    o++;
+  }
+  return o;
+}
+
+float fm_atan2( float y, float x ) {
+  // atan(z) ~ pi/4 z + 0.273 z (1 - |z|) for |z| <= 1
+  float ax = fabsf( x ), ay = fabsf( y );
+  if ((ax == 0) && (ay == 0)) return 0;
+  float r;
+  if (ax >= ay) {
+    float z = ay / ax;
+    r = z * (M_PI / 4 + 0.273f * (1 - z));
+  } else {
+    float z = ax / ay;
+    r = M_PI / 2 - z * (M_PI / 4 + 0.273f * (1 - z));
+  }
+  if (x < 0) r = M_PI - r;
+  return y < 0 ? -r : r;
+}
+
+int fm_format( const char *name ) {
+  if (strcmp( name, "u8" ) == 0) return FM_U8;
+  if (strcmp( name, "s16" ) == 0) return FM_S16;
+  if (strcmp( name, "f32" ) == 0) return FM_F32;
+  return -1;
+}
+
+size_t fm_sample_size( int format ) {
+  switch (format) {
+    case FM_U8: return 2 * sizeof(uint8_t);
+    case FM_S16: return 2 * sizeof(int16_t);
+    default: return 2 * sizeof(float);
+  }
+}
+
+/** decimation in front of and behind the discriminator for rate */
+static void fm_decimations( unsigned int rate, unsigned int *iq, unsigned int *audio ) {
+  *iq = (rate + FM_DEMOD_RATE - 1) / FM_DEMOD_RATE;
+  if (*iq == 0) *iq = 1;
+  *audio = (rate / *iq + FM_AUDIO_RATE / 2) / FM_AUDIO_RATE;
+  if (*audio == 0) *audio = 1;
+}
+
+unsigned int fm_decimation( unsigned int rate ) {
+  unsigned int iq, audio;
+  fm_decimations( rate, &iq, &audio );
+  return iq * audio;
+}
+
+int fm_demod_init( fm_demod_t *fm, int format, unsigned int rate, double offset, size_t block ) {
+  memset( fm, 0, sizeof(*fm) );
+  fm->format = format;
+  fm_decimations( rate, &fm->decim_iq, &fm->decim_audio );
+  fm->prev_i = 1;
+  fm->nco_i = 1;
+  fm->step_i = cos( -2 * M_PI * offset / rate );
+  fm->step_q = sin( -2 * M_PI * offset / rate );
+  if (fm_decim_init( &fm->lp, fm->decim_iq, FM_TAPS_PER_DECIMATION * fm->decim_iq + 1, FM_CUTOFF * 0.5 / fm->decim_iq ) != 0)
+    return -1;
+  fm->buf_len = block > 0 ? block : 1;
+  fm->buf = malloc( 2 * fm->buf_len * sizeof(fm->buf[0]) );
+  if (fm->buf == 0) {
+    logging_error( "Could not allocate %i IQ samples.\n", (int)fm->buf_len );
+    fm_decim_free( &fm->lp );
+    return -1;
+  }
+  logging_info( "FM demodulator: %+1.0f Hz, %i S/s %s IQ, /%i, discriminator at %i S/s, /%i, output at %i S/s.\n",
+    offset, rate, format == FM_U8 ? "u8" : format == FM_S16 ? "s16" : "f32", fm->decim_iq, rate / fm->decim_iq,
+    fm->decim_audio, rate / fm->decim_iq / fm->decim_audio );
+  return 0;
+}
+
+void fm_demod_free( fm_demod_t *fm ) {
+  fm_decim_free( &fm->lp );
+  free( fm->buf );
+  fm->buf = 0;
+}
+
+unsigned int fm_demod_decimation( fm_demod_t *fm ) {
+  return fm->decim_iq * fm->decim_audio;
+}
+
+/** fm_demod for at most buf_len samples */
+static size_t fm_demod_chunk( fm_demod_t *fm, const void *raw, size_t n, int16_t out[] ) {
+  size_t i, o = 0;
+  // convert to float
+  switch (fm->format) {
+    case FM_U8: {
+      const uint8_t *r = raw;
+      for (i = 0; i < 2*n; i++)
+        fm->buf[i] = (r[i] - 127.5f) * (1.0f / 128);
+      break;
+    }
+    case FM_S16: {
+      const int16_t *r = raw;
+      for (i = 0; i < 2*n; i++)
+        fm->buf[i] = r[i] * (1.0f / 32768);
+      break;
+    }
+    default:
+      memcpy( fm->buf, raw, 2 * n * sizeof(float) );
+  }
+  // move the channel to 0 Hz
+  if (fm->step_q != 0) {
+    float ni = fm->nco_i, nq = fm->nco_q;
+    for (i = 0; i < n; i++) {
+      float si = fm->buf[2*i], sq = fm->buf[2*i+1];
+      fm->buf[2*i] = si * ni - sq * nq;
+      fm->buf[2*i+1] = si * nq + sq * ni;
+      float t = ni * fm->step_i - nq * fm->step_q;
+      nq = ni * fm->step_q + nq * fm->step_i;
+      ni = t;
+    }
+    // keep the rotation from drifting away from unit length
+    float g = 1 / sqrtf( ni * ni + nq * nq );
+    fm->nco_i = ni * g;
+    fm->nco_q = nq * g;
+  }
+  // low pass and decimate
+  n = fm_decim( &fm->lp, fm->buf, n, fm->buf );
+  // polar discriminator: phase step between consecutive samples
+  for (i = 0; i < n; i++) {
+    float si = fm->buf[2*i], sq = fm->buf[2*i+1];
+    float re = si * fm->prev_i + sq * fm->prev_q;
+    float im = sq * fm->prev_i - si * fm->prev_q;
+    fm->prev_i = si;
+    fm->prev_q = sq;
+    fm->acc += fm_atan2( im, re );
+    if (++fm->acc_n < fm->decim_audio) continue;
+    float v = fm->acc * ((1<<14) / M_PI) / fm->decim_audio;
+    out[o++] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+    fm->acc = 0;
+    fm->acc_n = 0;
+  }
+  return o;
+}
+
+size_t fm_demod( fm_demod_t *fm, const void *raw, size_t n, int16_t out[] ) {
+  size_t o = 0;
+  // longer inputs than set up for go through the buffer in pieces
+  while (n > 0) {
+    size_t k = n < fm->buf_len ? n : fm->buf_len;
+    o += fm_demod_chunk( fm, raw, k, &out[o] );
+    raw = (const uint8_t *)raw + k * fm_sample_size( fm->format );
+    n -= k;
+  }
+  return o;
+}
@@ -0,0 +1,98 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef FM_DEMOD_H
+#define FM_DEMOD_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** FM demodulator for raw IQ samples, e.g. from rtl_sdr.
+ *
+ * The IQ stream is low pass filtered and decimated to about
+ * FM_DEMOD_RATE, demodulated by a polar discriminator, and the
+ * discriminator output is averaged down to about FM_AUDIO_RATE, which
+ * is what the transmission decoder expects. The output scaling follows
+ * rtl_fm: +-pi phase step per sample maps to +-(1<<14).
+ */
+
+/// the discriminator runs at no more than this rate
+#define FM_DEMOD_RATE 600000
+/// output rate the decimation is chosen for
+#define FM_AUDIO_RATE 75000
+
+/// raw IQ sample formats
+enum { FM_U8, FM_S16, FM_F32 };
+
+/** decimating low pass FIR filter for interleaved complex float samples.
+ * Only every decimation-th output is computed (polyphase form).
+ */
+typedef struct {
+  unsigned int decimation;
+  unsigned int taps;
+  float *h;          ///< taps coefficients
+  float *hist;       ///< 2*taps complex samples, mirrored like the td ring
+  unsigned int pos;  ///< next history slot
+  unsigned int phase;///< inputs since the last output
+} fm_decim_t;
+
+/** design a windowed sinc low pass with cutoff (fraction of the input
+ * rate, 0..0.5) and taps coefficients. returns 0 on success */
+int fm_decim_init( fm_decim_t *d, unsigned int decimation, unsigned int taps, float cutoff );
+void fm_decim_free( fm_decim_t *d );
+/** filter n complex samples from in, write the decimated ones to out
+ * (which may be in) and return their number */
+size_t fm_decim( fm_decim_t *d, const float in[], size_t n, float out[] );
+
+/// fast approximation of atan2 (max error about 0.005 rad)
+float fm_atan2( float y, float x );
+
+typedef struct {
+  int format;
+  unsigned int decim_iq;     ///< decimation before the discriminator
+  unsigned int decim_audio;  ///< decimation after the discriminator
+  float nco_i, nco_q;        ///< mixer phase
+  float step_i, step_q;      ///< mixer phase increment per sample
+  fm_decim_t lp;
+  float prev_i, prev_q;      ///< last discriminator input
+  float acc;                 ///< discriminator outputs summed for averaging
+  unsigned int acc_n;
+  float *buf;                ///< converted IQ samples
+  size_t buf_len;            ///< block of fm_demod_init(), in samples
+} fm_demod_t;
+
+/** parse "u8", "s16" or "f32", returns -1 if unknown */
+int fm_format( const char *name );
+/** bytes per complex sample of format */
+size_t fm_sample_size( int format );
+/** set up demodulation of IQ samples at rate of the channel offset Hz
+ * away from the center frequency, for fm_demod calls of up to block
+ * samples, returns 0 on success */
+int fm_demod_init( fm_demod_t *fm, int format, unsigned int rate, double offset, size_t block );
+void fm_demod_free( fm_demod_t *fm );
+/** overall decimation, i.e. input samples per output sample */
+unsigned int fm_demod_decimation( fm_demod_t *fm );
+/// the decimation fm_demod_init() chooses for rate
+unsigned int fm_decimation( unsigned int rate );
+/** demodulate n complex samples from raw into out, returns the number
+ * of output samples, at most n / fm_demod_decimation() + 1 */
+size_t fm_demod( fm_demod_t *fm, const void *raw, size_t n, int16_t out[] );
+
+#endif
@@ -0,0 +1,86 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/** rtl_868_gen: write a synthetic capture as S16LE to stdout, and
+ * optionally the frames it holds in the output format of rtl_868 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "siggen.h"
+#include "logging.h"
+
+int main( int argc, char **argv ) {
+  siggen_params_t p;
+  siggen_t g;
+  char *truth = 0;
+  int c;
+  unsigned int i;
+
+  logging_init();
+  siggen_defaults( &p );
+  while ((c = getopt( argc, argv, "n:S:b:O:d:x:r:s:e:" )) != -1)
+    switch (c) {
+      case 'n': p.frames = atoi( optarg ); break;
+      case 'S': p.snr = atof( optarg ); break;
+      case 'b': p.bitrate = atof( optarg ); break;
+      case 'O': p.offset = atof( optarg ); break;
+      case 'd': p.density = atof( optarg ); break;
+      case 'x': p.tx29 = atof( optarg ); break;
+      case 'r': p.rate = atoi( optarg ); break;
+      case 's': p.seed = atoi( optarg ); break;
+      case 'e': truth = optarg; break;
+      default:
+        fprintf( stderr,
+          "Usage: rtl_868_gen [PARAMETERS] > capture.raw\n"
+          "      -n frames   number of frames, defaults to %u.\n"
+          "      -S snr      signal to noise ratio in dB, defaults to %1.0f.\n"
+          "      -b factor   factor on the nominal bit rates, defaults to 1.\n"
+          "      -O hz       carrier frequency offset in Hz (deviation %1.0f Hz).\n"
+          "      -d rate     frames per second, defaults to %1.0f.\n"
+          "      -x share    fraction of TX29 frames, defaults to %1.1f.\n"
+          "      -r rate     sample rate, defaults to %u.\n"
+          "      -s seed     random seed.\n"
+          "      -e file     write the frames to file, one per line.\n",
+          p.frames, p.snr, p.deviation, p.density, p.tx29, p.rate );
+        return 1;
+    }
+  if (siggen_generate( &p, &g ) != 0)
+    return 1;
+  if (fwrite( g.samples, sizeof(g.samples[0]), g.length, stdout ) != g.length) {
+    logging_error( "Could not write the capture.\n" );
+    return 1;
+  }
+  if (truth != 0) {
+    FILE *f = fopen( truth, "w" );
+    if (f == 0) {
+      logging_error( "Could not open '%s'.\n", truth );
+      return 1;
+    }
+    // same columns as the data logger, the time replaced by the sample
+    for (i = 0; i < g.n_frames; i++)
+      fprintf( f, "%lu, %s, %i, %1.2f, %1.2f, %i.\n", (unsigned long)g.frames[i].end,
+        g.frames[i].protocol == SIGGEN_TX29 ? "tx29" : "ws300", g.frames[i].sensor_id,
+        g.frames[i].temp, g.frames[i].rel_hum, g.frames[i].flags );
+    fclose( f );
+  }
+  siggen_free( &g );
+  return 0;
+}
@@ -21,6 +21,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include "logging.h"
 
 int verbose = 0;
 int l_n = 0;
@@ -28,6 +37,279 @@ int l_n = 0;
 #define LOGGING_MODULES 16
 #define LOGGING_LENGTH 256
 char l_status[LOGGING_MODULES][LOGGING_LENGTH];
+/// serializes writing to stderr with the background thread
+pthread_mutex_t l_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* asynchronous logging: messages are captured as format and arguments
+ * into a bounded multi-producer ring (sequence numbers per slot, so
+ * producers only contend on one atomic increment) and formatted and
+ * written by a background thread. */
+
+/// number of queued messages, power of two
+#ifndef LOGGING_RING
+#define LOGGING_RING 1024
+#endif
+/// arguments per message
+#define LOGGING_ARGS 12
+/// bytes for the copies of %s arguments per message
+#define LOGGING_STRINGS 128
+/// how long the background thread sleeps if there is nothing to write
+#define LOGGING_IDLE_NS 1000000
+
+typedef union {
+  long long i;
+  double d;
+  const void *p;
+} l_arg_t;
+
+typedef struct {
+  atomic_size_t seq;
+  const char *f;
+  l_arg_t args[LOGGING_ARGS];
+  char strings[LOGGING_STRINGS];
+} l_record_t;
+
+l_record_t *l_ring;
+atomic_size_t l_enqueue;
+size_t l_dequeue;
+atomic_ulong l_drops;
+atomic_int l_async;
+atomic_int l_stop;
+pthread_t l_thread;
+
+/** one conversion of a printf format */
+typedef struct {
+  const char *start;   ///< the '%'
+  const char *end;     ///< after the conversion character
+  int stars;           ///< number of '*' for width and precision
+  char length;         ///< 0, 'H' (hh), 'h', 'l', 'q' (ll), 'L', 'z', 'j', 't'
+  char conv;
+} l_spec_t;
+
+/** parse the conversion at f (pointing at '%'), returns 0 on success */
+static int l_parse( const char *f, l_spec_t *sp ) {
+  sp->start = f++;
+  sp->stars = 0;
+  sp->length = 0;
+  while ((*f != 0) && (strchr( "-+ #0'", *f ) != 0)) f++;
+  if (*f == '*') { sp->stars++; f++; } else while (isdigit( (unsigned char)*f )) f++;
+  if (*f == '.') {
+    f++;
+    if (*f == '*') { sp->stars++; f++; } else while (isdigit( (unsigned char)*f )) f++;
+  }
+  switch (*f) {
+    case 'h': f++; sp->length = 'h'; if (*f == 'h') { f++; sp->length = 'H'; } break;
+    case 'l': f++; sp->length = 'l'; if (*f == 'l') { f++; sp->length = 'q'; } break;
+    case 'L': case 'z': case 'j': case 't': sp->length = *f++; break;
+  }
+  if (*f == 0) return -1;
+  sp->conv = *f++;
+  sp->end = f;
+  return 0;
+}
+
+/** read the arguments of f from ap into r, returns 0 on success */
+static int l_capture( l_record_t *r, const char *f, va_list ap ) {
+  int n = 0, i;
+  size_t sl = 0;
+  l_spec_t sp;
+  r->f = f;
+  for (; *f != 0; f++) {
+    if (*f != '%') continue;
+    if (f[1] == '%') { f++; continue; }
+    if ((l_parse( f, &sp ) != 0) || (n + sp.stars + 1 > LOGGING_ARGS)) return -1;
+    f = sp.end - 1;
+    for (i = 0; i < sp.stars; i++)
+      r->args[n++].i = va_arg( ap, int );
+    switch (sp.conv) {
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        switch (sp.length) {
+          case 'l': r->args[n++].i = va_arg( ap, long ); break;
+          case 'q': r->args[n++].i = va_arg( ap, long long ); break;
+          case 'z': r->args[n++].i = va_arg( ap, size_t ); break;
+          case 'j': r->args[n++].i = va_arg( ap, intmax_t ); break;
+          case 't': r->args[n++].i = va_arg( ap, ptrdiff_t ); break;
+          default: r->args[n++].i = va_arg( ap, int );
+        }
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        r->args[n++].d = sp.length == 'L' ? (double)va_arg( ap, long double ) : va_arg( ap, double );
+        break;
+      case 's': {
+        // copy the string, truncated to what is left
+        const char *str = va_arg( ap, const char * );
+        size_t l = str == 0 ? 0 : strlen( str );
+        if (l > LOGGING_STRINGS - 1 - sl) l = LOGGING_STRINGS - 1 - sl;
+        memcpy( &r->strings[sl], str, l );
+        r->strings[sl + l] = 0;
+        r->args[n++].i = sl;
+        sl += l + 1;
+        if (sl >= LOGGING_STRINGS) sl = LOGGING_STRINGS - 1;
+        break;
+      }
+      case 'p':
+        r->args[n++].p = va_arg( ap, void * );
+        break;
+      default:
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/** format r into line, like vsnprintf */
+static void l_format( const l_record_t *r, char *line, size_t size ) {
+  const char *f = r->f;
+  size_t o = 0;
+  int n = 0;
+  l_spec_t sp;
+  while ((*f != 0) && (o < size - 1)) {
+    if ((*f != '%') || (f[1] == '%') || (l_parse( f, &sp ) != 0)) {
+      line[o++] = *f;
+      f += (*f == '%') && (f[1] == '%') ? 2 : 1;
+      continue;
+    }
+    // the conversion on its own, with '*' replaced and without 'L'
+    char spec[32];
+    size_t k = 0;
+    const char *c;
+    for (c = sp.start; (c < sp.end) && (k < sizeof(spec) - 12); c++) {
+      if (*c == '*')
+        k += sprintf( &spec[k], "%i", (int)r->args[n++].i );
+      else if ((*c != 'L') || (c != sp.end - 2))
+        spec[k++] = *c;
+    }
+    spec[k] = 0;
+    const l_arg_t *a = &r->args[n++];
+    char *out = &line[o];
+    size_t room = size - o;
+    int w;
+    switch (sp.conv) {
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        w = snprintf( out, room, spec, a->d );
+        break;
+      case 's':
+        w = snprintf( out, room, spec, &r->strings[a->i] );
+        break;
+      case 'p':
+        w = snprintf( out, room, spec, a->p );
+        break;
+      default:
+        switch (sp.length) {
+          case 'l': w = snprintf( out, room, spec, (long)a->i ); break;
+          case 'q': w = snprintf( out, room, spec, (long long)a->i ); break;
+          case 'z': w = snprintf( out, room, spec, (size_t)a->i ); break;
+          case 'j': w = snprintf( out, room, spec, (intmax_t)a->i ); break;
+          case 't': w = snprintf( out, room, spec, (ptrdiff_t)a->i ); break;
+          default: w = snprintf( out, room, spec, (int)a->i );
+        }
+    }
+    if (w > 0) o += (size_t)w < room ? (size_t)w : room - 1;
+    f = sp.end;
+  }
+  line[o] = 0;
+}
+
+/** queue a message, never blocks */
+static void l_push( const char *f, va_list ap ) {
+  size_t pos = atomic_load_explicit( &l_enqueue, memory_order_relaxed );
+  l_record_t *r;
+  while (1) {
+    r = &l_ring[pos & (LOGGING_RING - 1)];
+    size_t seq = atomic_load_explicit( &r->seq, memory_order_acquire );
+    intptr_t d = (intptr_t)seq - (intptr_t)pos;
+    if (d == 0) {
+      if (atomic_compare_exchange_weak_explicit( &l_enqueue, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ))
+        break;
+    } else if (d < 0) {
+      atomic_fetch_add( &l_drops, 1 );
+      return;
+    } else {
+      pos = atomic_load_explicit( &l_enqueue, memory_order_relaxed );
+    }
+  }
+  va_list aq;
+  va_copy( aq, ap );
+  if (l_capture( r, f, aq ) != 0) {
+    // cannot be captured, keep the format only
+    r->f = "Message not captured: %s";
+    snprintf( r->strings, sizeof(r->strings), "%s", f );
+    r->args[0].i = 0;
+  }
+  va_end( aq );
+  atomic_store_explicit( &r->seq, pos + 1, memory_order_release );
+}
+
+/** write all queued messages, returns the number written */
+static int l_drain( void ) {
+  char line[1024];
+  int n = 0;
+  while (1) {
+    l_record_t *r = &l_ring[l_dequeue & (LOGGING_RING - 1)];
+    if (atomic_load_explicit( &r->seq, memory_order_acquire ) != l_dequeue + 1)
+      break;
+    l_format( r, line, sizeof(line) );
+    atomic_store_explicit( &r->seq, l_dequeue + LOGGING_RING, memory_order_release );
+    l_dequeue++;
+    pthread_mutex_lock( &l_lock );
+    logging_destatus();
+    fputs( line, stderr );
+    pthread_mutex_unlock( &l_lock );
+    n++;
+  }
+  return n;
+}
+
+static void *l_main( void *arg ) {
+  while (1) {
+    if (l_drain() > 0) continue;
+    if (atomic_load( &l_stop )) break;
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = LOGGING_IDLE_NS };
+    nanosleep( &ts, 0 );
+  }
+  l_drain();
+  return 0;
+}
+
+int logging_async(void) {
+  size_t i;
+  if (atomic_load( &l_async )) return 0;
+  l_ring = calloc( LOGGING_RING, sizeof(l_ring[0]) );
+  if (l_ring == 0) return -1;
+  for (i = 0; i < LOGGING_RING; i++)
+    atomic_init( &l_ring[i].seq, i );
+  atomic_init( &l_enqueue, 0 );
+  l_dequeue = 0;
+  atomic_init( &l_stop, 0 );
+  if (pthread_create( &l_thread, 0, l_main, 0 ) != 0) {
+    free( l_ring );
+    return -1;
+  }
+  atomic_store( &l_async, 1 );
+  // messages logged right before exit() are still written
+  atexit( logging_stop );
+  return 0;
+}
+
+void logging_stop(void) {
+  if (!atomic_exchange( &l_async, 0 )) return;
+  atomic_store( &l_stop, 1 );
+  pthread_join( l_thread, 0 );
+  if (atomic_load( &l_drops ) > 0)
+    fprintf( stderr, "%lu log messages dropped, the log ring was full.\n", atomic_load( &l_drops ) );
+  free( l_ring );
+  l_ring = 0;
+}
+
+/** write a message now or queue it */
+static void l_output( const char *f, va_list ap ) {
+  if (atomic_load_explicit( &l_async, memory_order_relaxed )) {
+    l_push( f, ap );
+  } else {
+    logging_destatus();
+    vfprintf( stderr, f, ap );
+  }
+}
 
 void logging_init(void) {
   int i;
@@ -42,10 +324,12 @@ void logging_destatus(void){
 }
 void logging_restatus(void){
   int i;
+  pthread_mutex_lock( &l_lock );
   logging_destatus();
   for (i = 0; i<LOGGING_MODULES; i++) {
     l_n += fprintf( stderr, "%s", l_status[i] );
   }
+  pthread_mutex_unlock( &l_lock );
 }
 void _logging_status(int module,  const char* f, ... ) {
   if ((module >= LOGGING_MODULES) || (module < 0) || (verbose < 0)) return;
@@ -58,46 +342,41 @@ void _logging_status(int module,  const char* f, ... ) {
 
 void _logging_verbose( const char* f, ... ) {
   if (verbose > 3) {
-    logging_destatus();
     va_list argp;
     va_start(argp, f);
-    vfprintf( stderr, f, argp );
+    l_output( f, argp );
     va_end(argp);
   }
 }
 void _logging_info( const char* f, ... ) {
   if (verbose > 2) {
-    logging_destatus();
     va_list argp;
     va_start(argp, f);
-    vfprintf( stderr, f, argp );
+    l_output( f, argp );
     va_end(argp);
   }
 }
 void _logging_warning( const char* f, ... ) {
   if (verbose > 1) {
-    logging_destatus();
     va_list argp;
     va_start(argp, f);
-    vfprintf( stderr, f, argp );
+    l_output( f, argp );
     va_end(argp);
   }
 }
 void _logging_error( const char* f, ... ) {
   if (verbose > 0) {
-    logging_destatus();
     va_list argp;
     va_start(argp, f);
-    vfprintf( stderr, f, argp );
+    l_output( f, argp );
     va_end(argp);
   }
 }
 void _logging_message( const char* f, ... ) {
   if (verbose > -1) {
-    logging_destatus();
     va_list argp;
     va_start(argp, f);
-    vfprintf( stderr, f, argp );
+    l_output( f, argp );
     va_end(argp);
   }
 }
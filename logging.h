@@ -26,13 +26,33 @@ extern int verbose;
 #define LOGGING_STRR(arg) #arg
 #define LOGGING_STR(arg) LOGGING_STRR( arg )
 
-#define logging_verbose( args... ) do { _logging_verbose( "V: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
-#define logging_info( args... ) do { _logging_info( "I: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
-#define logging_warning( args... ) do { _logging_warning( "W: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
-#define logging_error( args... ) do { _logging_error( "E: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
-#define logging_message( args... ) do { _logging_mesage( args ); } while (0)
+/// levels, a message is shown if verbose is at least its level
+#define LOGGING_ERROR 1
+#define LOGGING_WARNING 2
+#define LOGGING_INFO 3
+#define LOGGING_VERBOSE 4
+
+/** messages above this level are removed at compile time, arguments
+ * included. e.g. build with CFLAGS += -DLOGGING_LEVEL=2 for warnings and
+ * errors only */
+#ifndef LOGGING_LEVEL
+#define LOGGING_LEVEL LOGGING_VERBOSE
+#endif
+
+/// whether a message of level would be shown, checked before the call
+#define logging_enabled( level ) ((LOGGING_LEVEL >= (level)) && (verbose >= (level)))
+
+#define logging_verbose( args... ) do { if (logging_enabled( LOGGING_VERBOSE )) _logging_verbose( "V: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
+#define logging_info( args... ) do { if (logging_enabled( LOGGING_INFO )) _logging_info( "I: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
+#define logging_warning( args... ) do { if (logging_enabled( LOGGING_WARNING )) _logging_warning( "W: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
+#define logging_error( args... ) do { if (logging_enabled( LOGGING_ERROR )) _logging_error( "E: " __FILE__ ":" LOGGING_STR(__LINE__) ": " args ); } while (0)
+/// continue the line of a previous logging_verbose() or logging_info()
+#define logging_verbose_cont( args... ) do { if (logging_enabled( LOGGING_VERBOSE )) _logging_verbose( args ); } while (0)
+#define logging_info_cont( args... ) do { if (logging_enabled( LOGGING_INFO )) _logging_info( args ); } while (0)
+#define logging_message( args... ) do { _logging_message( args ); } while (0)
 #define logging_status( n, str, args... ) do { _logging_status( n,  str "; ", args ); } while (0)
 
+void logging_destatus(void);
 void logging_restatus(void);
 void _logging_status(int module,  const char* f, ... );
 void _logging_verbose( const char* f, ... );
@@ -41,6 +61,12 @@ void _logging_warning( const char* f, ... );
 void _logging_error( const char* f, ... );
 void _logging_message( const char* f, ... );
 void logging_init(void);
-          
+/** from now on, messages are queued in a ring and written by a
+ * background thread. The format must be a string literal (or live as
+ * long), %s arguments are copied. Messages are dropped if the ring is
+ * full. returns 0 on success */
+int logging_async(void);
+/// write everything queued and stop the background thread
+void logging_stop(void);
 
 #endif
@@ -20,13 +20,28 @@
 
 
 #include "nrz_decode.h"
+#include "nrz_stream.h"
 #include "transmission.h"
 #include "ws300.h"
 #include "logging.h"
 #include "tx29.h"
 #include "data_logger.h"
+#include "pipeline.h"
+#include "stream_dispatch.h"
+#include "fm_demod.h"
+#include "channelizer.h"
+#include "replay.h"
+#include "outfile.h"
+#include "dedup.h"
+#include "burst.h"
+#include "pool.h"
+#include "metrics.h"
+#include "trace.h"
+#include "sample_clock.h"
+#include "sample_rate.h"
 
 #include <unistd.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 
 #include <time.h>
@@ -35,6 +50,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 #include <time.h>
 
 int data_to_string( float data, float* base, char* cexp ) {
@@ -54,35 +70,82 @@ int data_to_string( float data, float* base, char* cexp ) {
   return 1;
 }
 
-FILE *in, *out;
-int duplicate_stream_input( int transmission[], unsigned int length ) {
-  if ((ws300.input( transmission, length) == 0) ||
-    (tx29.input(transmission, length) == 0))
+FILE *in;
+/// the data logger, undecodable transmissions are written to its file as
+/// well (text output only)
+data_logger_t *dl;
+int dump_raw = 1;
+/// the bit decoders behind the burst recorders
+bit_decoder_t *(*bd_recorded)( void ) = 0;
+
+bit_decoder_t *bd_record_create( void ) {
+  return burst_tee_create( bd_recorded() );
+}
+
+/** the stream decoders: ws300 and tx29, sharing one preamble search */
+stream_decoder_t *decoders_create( void ) {
+  stream_decoder_t *dispatch = dispatch_create();
+  if ((dispatch == 0) ||
+      (dispatch_add( dispatch, ws300_create() ) != 0) ||
+      (dispatch_add( dispatch, tx29_create() ) != 0))
+    return 0;
+  return dispatch;
+}
+
+int dump_stream_input( stream_decoder_t *self, int transmission[], unsigned int length, const rx_info_t *rx ) {
+  stream_decoder_t *next = self->ctx;
+  if (next->input( next, transmission, length, rx ) == 0)
     return 0;
   else if (verbose > 1) {
     if (length < 6) return -1;
-    fprintf( out, "__, %i, ", length );
+    // one line, written between the records under the lock of the file
+    char line[32 + 3 * length];
+    int n = sprintf( line, "__, %i, ", length );
     while (length-- > 0)
-      fprintf( out, "%02x ", *transmission++ );
-    fprintf( out, "\n" );
-    fflush(out);
+      n += sprintf( &line[n], "%02x ", *transmission++ & 0xff );
+    strcpy( &line[n], "\n" );
+    outfile_raw( dl, line );
     return 0;
   } else {
     return 0;
   }
 }
 
+void rotate_handler( int sig ) {
+  outfile_rotate_request();
+}
+
 int main (int argc, char **argv) {
 
   char* filename = 0;
   char* outfilename = 0;
+  int threaded = 0;
+  bit_decoder_t *(*bd_create)( void ) = nrz_create;
+  int iq_format = -1;
+  /// sample rate of the input, 0 for that of its format
+  unsigned int in_rate = 0;
+  double center = 0;
+  int replay = 0;
+  int jobs = 1;
+  int workers = 1;
+  int async = 0;
+  data_logger_t *(*dl_create)( void ) = dl_file_create;
+  outfile_params_t op = { .sync = OUTFILE_SYNC_NONE };
+  double dedup_window = 0;
+  int commit_records = -1;
+  char *metrics_file = 0;
+  char *trace_file = 0;
+  double anchor = 0;
+  char *burst_file = 0;
+  size_t budget = 0;
+  int bursts = 0;
   int c;
   
   logging_init();
   
   opterr = 0;
   
-  while ((c = getopt (argc, argv, "vqf:o:")) != -1)
+  while ((c = getopt (argc, argv, "vqLtsmbw:j:A:i:r:F:c:f:o:O:n:u:y:R:Z:D:M:T:a:B:")) != -1)
     switch (c)
     {
       case 'v':
@@ -91,6 +154,63 @@ int main (int argc, char **argv) {
       case 'q':
         verbose--;
         break;
+      case 'L':
+        async = 1;
+        break;
+      case 't':
+        threaded = 1;
+        break;
+      case 's':
+        bd_create = nrzs_create;
+        break;
+      case 'm':
+        replay = 1;
+        break;
+      case 'b':
+        bursts = 1;
+        break;
+      case 'B':
+        burst_file = optarg;
+        break;
+      case 'w':
+        workers = atoi( optarg );
+        if ((workers < 1) || (workers > PIPELINE_WORKERS)) {
+          logging_error( "Invalid number of workers '%s', 1 to %i.\n", optarg, PIPELINE_WORKERS );
+          return 1;
+        }
+        threaded = 1;
+        break;
+      case 'A':
+        budget = atof( optarg ) * (1 << 20);
+        break;
+      case 'j':
+        jobs = atoi( optarg );
+        if (jobs < 1) {
+          logging_error( "Invalid number of replay jobs '%s'.\n", optarg );
+          return 1;
+        }
+        break;
+      case 'i':
+        iq_format = fm_format( optarg );
+        if (iq_format < 0) {
+          logging_error( "Unknown IQ format '%s', use u8, s16 or f32.\n", optarg );
+          return 1;
+        }
+        break;
+      case 'r':
+        in_rate = atoi( optarg );
+        if (in_rate == 0) {
+          logging_error( "Invalid sample rate '%s'.\n", optarg );
+          return 1;
+        }
+        break;
+      case 'F':
+        center = atof( optarg );
+        break;
+      case 'c':
+        if (ch_add( atof( optarg ) ) != 0)
+          return 1;
+        break;
       case 'f':
         if (filename != 0) {
           logging_info( "Overriding previous -f flag '%s' with '%s'.\n", filename, optarg );
@@ -103,8 +223,57 @@ int main (int argc, char **argv) {
         }
         outfilename = optarg;
         break;
+      case 'O':
+        if (strcmp( optarg, "text" ) == 0) {
+          dl_create = dl_file_create;
+        } else if (strcmp( optarg, "bin" ) == 0) {
+          dl_create = dl_bin_create;
+          dump_raw = 0;
+        } else {
+          logging_error( "Unknown output format '%s', use text or bin.\n", optarg );
+          return 1;
+        }
+        break;
+      case 'M':
+        metrics_file = optarg;
+        break;
+      case 'T':
+        trace_file = optarg;
+        break;
+      case 'a':
+        anchor = atof( optarg );
+        break;
+      case 'n':
+        commit_records = atoi( optarg );
+        break;
+      case 'u':
+        op.commit_interval = atoi( optarg );
+        break;
+      case 'y':
+        op.sync = outfile_sync( optarg );
+        if (op.sync < 0) {
+          logging_error( "Unknown sync policy '%s', use none, rotate or commit.\n", optarg );
+          return 1;
+        }
+        break;
+      case 'R':
+        op.rotate_interval = atoi( optarg );
+        break;
+      case 'Z': {
+        char *e;
+        op.rotate_size = strtoull( optarg, &e, 10 );
+        if ((*e == 'k') || (*e == 'K')) op.rotate_size <<= 10;
+        else if (*e == 'M') op.rotate_size <<= 20;
+        else if (*e == 'G') op.rotate_size <<= 30;
+        break;
+      }
+      case 'D':
+        dedup_window = atof( optarg );
+        break;
       case '?':
-        if ((optopt == 'f') || (optopt == 'o') || (optopt == 'd'))
+        if ((optopt == 'f') || (optopt == 'o') || (optopt == 'O') ||
+            (optopt == 'n') || (optopt == 'u') || (optopt == 'y') || (optopt == 'R') || (optopt == 'Z') || (optopt == 'D') || (optopt == 'M') || (optopt == 'T') || (optopt == 'a') || (optopt == 'B') || (optopt == 'j') || (optopt == 'A') || (optopt == 'w') || (optopt == 'i') || (optopt == 'r') ||
+            (optopt == 'F') || (optopt == 'c'))
           fprintf (stderr, "Option -%c requires an argument.\n", optopt);
         else if (isprint (optopt))
           fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -125,8 +294,43 @@ int main (int argc, char **argv) {
           "   [PARAMETERS]   Unix style parameters with possible values:\n"
           "      -v          be more verbose. accumulates when given multiple times.\n"
           "      -q          be less verbose.\n"
+          "      -L          write log messages from a background thread.\n"
+          "      -M file     write counters and histograms to file every second, in\n"
+          "                  the Prometheus text format.\n"
+          "      -T file     trace every record through the stages of the decoder and\n"
+          "                  write the trace to file, for chrome://tracing or Perfetto.\n"
           "      -f file     open file instead of stdin.\n"
-          "      -o file     open file instead of stdout.\n"
+          "      -o file     open file instead of stdout. The name may hold strftime\n"
+          "                  conversions, e.g. temp-%%Y%%m%%d.csv, and is reopened on\n"
+          "                  SIGHUP or SIGUSR1.\n"
+          "      -n count    flush the output every count records. Defaults to 1 for\n"
+          "                  text, binary logs are written in blocks.\n"
+          "      -u sec      flush the output at least every sec seconds.\n"
+          "      -y policy   fdatasync the output: none (default), rotate (when a file\n"
+          "                  is closed) or commit (on every flush).\n"
+          "      -R sec      start a new output file every sec seconds, e.g. 86400.\n"
+          "      -Z size     start a new output file at size bytes (k, M, G suffix).\n"
+          "      -D sec      write repeated readings of a sensor within sec seconds\n"
+          "                  once, with the number of copies as last column.\n"
+          "      -O fmt      output format, text (default) or bin. Binary logs are\n"
+          "                  written in blocks and exported with rtl_868_dump.\n"
+          "      -t          run detection and decoding in their own threads.\n"
+          "      -w n        like -t, with n threads decoding the transmissions.\n"
+          "      -s          use the streaming NRZ decoder.\n"
+          "      -a time     the input started at time (seconds since the epoch), e.g.\n"
+          "                  to reproduce the timestamps of a capture.\n"
+          "      -B file     append the transmissions found to the burst capture file.\n"
+          "      -b          input is a burst capture, decoded without the detector.\n"
+          "      -m          replay the input file from memory instead of reading it.\n"
+          "      -j n        with -m, decode n segments of the file in parallel.\n"
+          "      -A MB       limit the buffers of the decoders to MB megabytes.\n"
+          "      -i fmt      input is raw IQ (u8, s16 or f32) instead of FM demodulated\n"
+          "                  S16LE, e.g. from rtl_sdr.\n"
+          "      -r rate     sample rate of the input, defaults to 75000 for S16LE and\n"
+          "                  1200000 for IQ.\n"
+          "      -F freq     center frequency of the IQ input in Hz.\n"
+          "      -c freq     decode the channel at freq Hz, may be given multiple times.\n"
+          "                  each channel runs in its own thread.\n"
           "\n"
         );
         return 1;
@@ -146,6 +350,11 @@ int main (int argc, char **argv) {
     }
   }
 
+  if (async && (logging_async() != 0)) {
+    logging_error( "Could not start the logging thread.\n" );
+    return 1;
+  }
+
   if (filename == 0) {
     filename = "-";
   }
@@ -174,35 +383,166 @@ int main (int argc, char **argv) {
     return 1;
   }
 
-  if ((outfilename == 0) || (strcmp( outfilename, "-" ) == 0))
-    out = stdout;
+  // stage latencies go to the metrics and the trace file
+  if ((trace_file != 0) && (trace_open( trace_file ) != 0))
+    return 1;
+  if (metrics_file != 0)
+    trace_enable();
+
+  op.pattern = outfilename;
+  op.raw = dump_raw;
+  if (commit_records >= 0)
+    op.commit_records = commit_records;
   else
-    out = fopen( outfilename, "a" );
-  if (out == 0) {
-    if (outfilename == 0) {
-      logging_error( "Could not open stdout as output file.\n" );
-    } else {
-      logging_error( "Could not open output file '%s'.\n", outfilename );
-    }
+    op.commit_records = dl_create == dl_file_create ? 1 : 0;
+  // rotate the output on request, e.g. by logrotate
+  struct sigaction sa;
+  memset( &sa, 0, sizeof(sa) );
+  sa.sa_handler = rotate_handler;
+  sa.sa_flags = SA_RESTART;
+  sigaction( SIGHUP, &sa, 0 );
+  sigaction( SIGUSR1, &sa, 0 );
+
+  if (replay && (in == stdin)) {
+    logging_error( "Replay (-m) requires an input file.\n" );
     return 1;
   }
+  if (replay)
+    threaded = 0;
+  if ((ch_count() > 0) && (iq_format < 0)) {
+    logging_error( "Channels (-c) require IQ input (-i).\n" );
+    return 1;
+  }
+  if ((ch_count() > 0) && (center == 0)) {
+    logging_error( "Channels (-c) require the center frequency (-F).\n" );
+    return 1;
+  }
+  if (bursts && (replay || (iq_format >= 0))) {
+    logging_error( "Burst captures (-b) cannot be replayed (-m) or demodulated (-i).\n" );
+    return 1;
+  }
+  if (bursts)
+    threaded = 0;
+  if (in_rate == 0)
+    in_rate = iq_format >= 0 ? 1200000 : SRATE_DEFAULT;
+  if ((burst_file != 0) && (jobs > 1)) {
+    logging_error( "Bursts cannot be recorded (-B) from parallel replays (-j).\n" );
+    return 1;
+  }
+  if (burst_file != 0) {
+    bd_recorded = bd_create;
+    bd_create = bd_record_create;
+  }
+
+  /* the transmission decoders run at the rate of the S16LE input, which
+   * rtl_fm is run with, or of the demodulated IQ input. Their time
+   * constants follow from it, their buffers are sized for it, for every
+   * chain of decoders running at a time */
+  double rate = in_rate;
+  if (iq_format >= 0)
+    rate = (double)in_rate / fm_decimation( in_rate );
+  else if (bursts && (burst_open( in, &rate ) != 0))
+    return 1;
+  unsigned int chains = 1;
+  if (ch_count() > chains) chains = ch_count();
+  // parallel replays have a chain per job besides the one of main
+  if (replay && (jobs > 1)) chains = jobs + 1;
+  if (threaded && (workers > chains)) chains = workers;
+  srate_set( rate );
+  pool_budget( budget );
+  if (pool_chain( rate, chains ) != 0)
+    return 1;
 
-  stream_decoder_t mysd = { .init = 0, .input = &duplicate_stream_input };
-  
   // construct the signal chain
-  /* transmission decoder */
-  td.init( &nrz );
-  /* nrz */
-  nrz.init( &mysd );
   /* ws300 and tx29 */
-  ws300.init( &dl_file );
-  tx29.init( &dl_file );
-  /* dl_file */
-  dl_file.init( out );
+  stream_decoder_t *dispatch = decoders_create();
+  if (dispatch == 0)
+    return 1;
+  /* dl_file or dl_bin, in files by op */
+  dl = outfile_create( &op, dl_create );
+  /* repeated readings only once */
+  data_logger_t *logger = dl;
+  if ((dl != 0) && (dedup_window > 0))
+    logger = dedup_create( dl, dedup_window );
+  if ((logger == 0) || (dispatch->init( dispatch, logger ) != 0) || (dl->init( dl, 0 ) != 0) ||
+      ((logger != dl) && (logger->init( logger, 0 ) != 0)))
+    return 1;
+  /* raw dump of what the dispatcher did not take */
+  stream_decoder_t mysd = { .ctx = dispatch, .init = 0, .input = &dump_stream_input };
+
+  // only drop samples if we cannot slow down the source
+  struct stat st;
+  int lossless = (fstat( fileno( in ), &st ) == 0) && S_ISREG( st.st_mode );
+  sample_decoder_t *sd = 0;
+  bit_decoder_t *bd = 0;
+  if (ch_count() > 0) {
+    /* transmission decoder and nrz per channel, in their own threads */
+    if (ch_start( iq_format, in_rate, center, td_create, bd_create, &mysd, lossless ) != 0)
+      return 1;
+    threaded = 0;
+  } else if (bursts) {
+    /* nrz only, the capture holds the transmissions */
+    bd = bd_create();
+    if ((bd == 0) || (bd->init( bd, &mysd ) != 0))
+      return 1;
+  } else {
+    /* transmission decoder and nrz */
+    sd = td_create();
+    if (sd == 0)
+      return 1;
+    if (threaded && (workers > 1)) {
+      /* the workers have decoders of their own, without the raw dump */
+      if (pipeline_start_workers( workers, sd, bd_create, decoders_create, logger, lossless ) != 0)
+        return 1;
+    } else if ((bd = bd_create()) == 0) {
+      return 1;
+    } else if (threaded) {
+      /* run in a detection and a worker thread, connected by a queue */
+      if (pipeline_start( sd, bd, &mysd, lossless ) != 0)
+        return 1;
+    } else {
+      if ((sd->init( sd, bd ) != 0) || (bd->init( bd, &mysd ) != 0))
+        return 1;
+    }
+  }
   
-  uint16_t d[1024];
+  /* raw IQ input is demodulated here, one block of output needs
+   * fm_demod_decimation() input samples */
+  fm_demod_t fm;
+  void *raw = 0;
+  size_t raw_len = 0;
+  if (ch_count() > 0) {
+    raw_len = ch_block_length();
+    raw = malloc( raw_len * fm_sample_size( iq_format ) );
+    if (raw == 0) {
+      logging_error( "Could not allocate the IQ input buffer.\n" );
+      return 1;
+    }
+  } else if (iq_format >= 0) {
+    if (fm_demod_init( &fm, iq_format, in_rate, 0, PIPELINE_BLOCK * fm_decimation( in_rate ) ) != 0)
+      return 1;
+    raw_len = PIPELINE_BLOCK * fm_demod_decimation( &fm );
+    raw = malloc( raw_len * fm_sample_size( iq_format ) );
+    if (raw == 0) {
+      logging_error( "Could not allocate the IQ input buffer.\n" );
+      return 1;
+    }
+  }
+
+  /* records are stamped by the sample clock, which counts the samples
+   * of the transmission decoders */
+  unsigned int ndata_per_sample = ch_count() > 0 ? raw_len / PIPELINE_BLOCK : 1;
+  sclock_start( rate, (long long)(anchor * 1e9) );
+  // live input follows the wall clock, files keep the time line of the capture
+  int follow = !lossless && !replay && !bursts && (anchor == 0);
+  if ((burst_file != 0) && (burst_record( burst_file, rate ) != 0))
+    return 1;
+
+  int16_t d[PIPELINE_BLOCK];
   unsigned long long int ndata = 0;
   unsigned long long int last_ndata = 0;
+  /// samples read but not decoded, as the pipeline was full
+  unsigned long long int dropped = 0;
   
   struct timespec last_status;
 #ifdef __APPLE__
@@ -212,11 +552,49 @@ int main (int argc, char **argv) {
   clock_gettime( CLOCK_MONOTONIC, &last_status );
 #endif
   
-  // read from stdin S16LE data
-  while (1) {
-    /* read a chunk */
-    int n = fread( d, sizeof(d[0]), sizeof(d)/sizeof(d[0]), in );
-    if (n == 0) {
+  if (replay) {
+    /* decode the mapped file instead of reading it */
+    if (replay_open( filename, iq_format >= 0 ? fm_sample_size( iq_format ) : sizeof(d[0]) ) != 0)
+      return 1;
+    if (ch_count() > 0) {
+      size_t i, total = replay_samples();
+      for (i = 0; i < total; i += raw_len)
+        ch_push( (const char *)replay_data() + i * fm_sample_size( iq_format ), total - i < raw_len ? total - i : raw_len );
+    } else if (jobs > 1) {
+      if (replay_run_parallel( jobs, iq_format, in_rate, td_create, bd_create, decoders_create, logger ) != 0)
+        return 1;
+    } else {
+      replay_run( sd, iq_format >= 0 ? &fm : 0 );
+    }
+    replay_close();
+  }
+  if (bursts) {
+    long n = burst_replay( in, bd );
+    if (n < 0)
+      return 1;
+    logging_info( "Decoded %li bursts.\n", n );
+  }
+
+  // read from stdin S16LE data, or IQ data to be demodulated
+  while (!replay && !bursts) {
+    /* read a chunk, in threaded mode directly into the queue */
+    int16_t *block = d;
+    if (threaded && ((block = pipeline_block()) == 0))
+      block = d;
+    int n;
+    if (raw == 0) {
+      n = fread( block, sizeof(d[0]), sizeof(d)/sizeof(d[0]), in );
+    } else {
+      n = fread( raw, fm_sample_size( iq_format ), raw_len, in );
+      // a short read may not complete an output sample
+      if (ch_count() > 0)
+        n = n > 0 ? n : -1;
+      else if (n > 0)
+        n = fm_demod( &fm, raw, n, block );
+      else
+        n = -1;
+    }
+    if ((n < 0) || ((n == 0) && (raw == 0))) {
       logging_error( "\nEOF reached at %i.\n", ndata );
       break;
     } else {
@@ -245,18 +623,57 @@ int main (int argc, char **argv) {
       float tp_b;
       data_to_string( throughput, &tp_b, &tp_e );
       logging_status( 0, "%s -> %s, %1.1f%c, %1.1f%c", filename, outfilename, nd_b, nd_e, tp_b, tp_e );
+      if (threaded)
+        pipeline_status();
+      else if (ch_count() > 0)
+        ch_status();
     
       logging_restatus();
+      outfile_tick( dl );
+      if (follow)
+        sclock_update( (ndata - dropped) / ndata_per_sample );
+      if (logger != dl)
+        dedup_tick( logger, sclock_time( (ndata - dropped) / ndata_per_sample ) );
+      if (metrics_file != 0)
+        metrics_write( metrics_file );
       last_status.tv_sec = now.tv_sec;
       last_status.tv_nsec = now.tv_nsec;
     }
     
     /* and put the chunk into the transmission decoder */
-    int i;
-    for (i = 0; i<n; i++) {
-      td.input( d[i] );
+    if (ch_count() > 0)
+      ch_push( raw, n );
+    else if (!threaded)
+      sd->input_block( sd, block, n );
+    else if (block != d)
+      pipeline_push( n );
+    else {
+      pipeline_drop( n );
+      dropped += n;
     }
   }
 
+  if (threaded)
+    pipeline_stop();
+  else if (ch_count() > 0)
+    ch_stop();
+  if (metrics_file != 0)
+    metrics_write( metrics_file );
+  trace_close();
+  burst_close();
+  if (sd != 0)
+    sd->destroy( sd );
+  if (bd != 0)
+    bd->destroy( bd );
+  dispatch->destroy( dispatch );
+  if (logger != dl)
+    logger->destroy( logger );
+  dl->destroy( dl );
+  if ((raw != 0) && (ch_count() == 0))
+    fm_demod_free( &fm );
+  free( raw );
   fclose(in);
+  pool_report();
+  pool_free();
+  logging_stop();
 }
@@ -0,0 +1,166 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "metrics.h"
+#include "logging.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+metric_t metrics[METRICS_MAX];
+atomic_int metrics_n;
+/// registration only, updates are lock free
+pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static metric_t *metrics_register( const char *name, const char *help, int type, const double *bounds, int n ) {
+  metric_t *m = 0;
+  int i;
+  pthread_mutex_lock( &metrics_lock );
+  int count = atomic_load( &metrics_n );
+  for (i = 0; i < count; i++) {
+    if (strcmp( metrics[i].name, name ) == 0) {
+      m = &metrics[i];
+      break;
+    }
+  }
+  if ((m == 0) && (count < METRICS_MAX)) {
+    m = &metrics[count];
+    m->name = name;
+    m->help = help;
+    m->type = type;
+    m->bounds = bounds;
+    m->n_bounds = n < METRICS_BUCKETS ? n : METRICS_BUCKETS - 1;
+    atomic_store( &metrics_n, count + 1 );
+  } else if (m == 0) {
+    logging_warning( "Too many metrics, not registering %s.\n", name );
+  }
+  pthread_mutex_unlock( &metrics_lock );
+  return m;
+}
+
+metric_t *metrics_counter( const char *name, const char *help ) {
+  return metrics_register( name, help, METRICS_COUNTER, 0, 0 );
+}
+
+metric_t *metrics_gauge( const char *name, const char *help ) {
+  return metrics_register( name, help, METRICS_GAUGE, 0, 0 );
+}
+
+metric_t *metrics_histogram( const char *name, const char *help, const double *bounds, int n ) {
+  return metrics_register( name, help, METRICS_HISTOGRAM, bounds, n );
+}
+
+void metrics_observe( metric_t *m, double v ) {
+  int i;
+  if (m == 0) return;
+  for (i = 0; (i < m->n_bounds) && (v > m->bounds[i]); i++);
+  atomic_fetch_add_explicit( &m->buckets[i], 1, memory_order_relaxed );
+  atomic_fetch_add_explicit( &m->value, 1, memory_order_relaxed );
+  // add to the double in place
+  unsigned long long old = atomic_load_explicit( &m->sum, memory_order_relaxed ), new;
+  do {
+    double d;
+    memcpy( &d, &old, sizeof(d) );
+    d += v;
+    memcpy( &new, &d, sizeof(new) );
+  } while (!atomic_compare_exchange_weak_explicit( &m->sum, &old, new, memory_order_relaxed, memory_order_relaxed ));
+}
+
+/** length of the name without labels */
+static size_t metrics_base( const char *name ) {
+  const char *l = strchr( name, '{' );
+  return l == 0 ? strlen( name ) : (size_t)(l - name);
+}
+
+/** print name with suffix and an extra label, e.g. foo_bucket{a="b",le="1"} */
+static void metrics_name( FILE *f, const char *name, const char *suffix, const char *label ) {
+  size_t base = metrics_base( name );
+  fprintf( f, "%.*s%s", (int)base, name, suffix );
+  if (name[base] == '{') {
+    // the labels without the closing brace
+    fprintf( f, "%.*s%s%s}", (int)(strlen( name ) - base - 1), &name[base], label[0] ? "," : "", label );
+  } else if (label[0]) {
+    fprintf( f, "{%s}", label );
+  }
+}
+
+/** whether a and b have the same name without labels */
+static int metrics_same_base( const metric_t *a, const metric_t *b ) {
+  size_t base = metrics_base( a->name );
+  return (base == metrics_base( b->name )) && (strncmp( a->name, b->name, base ) == 0);
+}
+
+static void metrics_print( FILE *f, metric_t *m ) {
+  int j;
+  if (m->type != METRICS_HISTOGRAM) {
+    fprintf( f, "%s %lli\n", m->name, atomic_load_explicit( &m->value, memory_order_relaxed ) );
+    return;
+  }
+  char le[64];
+  long long cumulative = 0;
+  for (j = 0; j <= m->n_bounds; j++) {
+    cumulative += atomic_load_explicit( &m->buckets[j], memory_order_relaxed );
+    if (j < m->n_bounds)
+      snprintf( le, sizeof(le), "le=\"%g\"", m->bounds[j] );
+    else
+      snprintf( le, sizeof(le), "le=\"+Inf\"" );
+    metrics_name( f, m->name, "_bucket", le );
+    fprintf( f, " %lli\n", cumulative );
+  }
+  unsigned long long bits = atomic_load_explicit( &m->sum, memory_order_relaxed );
+  double sum;
+  memcpy( &sum, &bits, sizeof(sum) );
+  metrics_name( f, m->name, "_sum", "" );
+  fprintf( f, " %g\n", sum );
+  metrics_name( f, m->name, "_count", "" );
+  // the buckets may have moved on, keep count consistent with them
+  fprintf( f, " %lli\n", cumulative );
+}
+
+int metrics_write( const char *filename ) {
+  static const char *types[] = { "counter", "gauge", "histogram" };
+  char tmp[1024];
+  int i, j, count = atomic_load( &metrics_n );
+  if (snprintf( tmp, sizeof(tmp), "%s.tmp", filename ) >= sizeof(tmp))
+    return -1;
+  FILE *f = fopen( tmp, "w" );
+  if (f == 0) {
+    logging_error( "Could not open metrics file '%s'.\n", tmp );
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    // all labels of a name together, after one header
+    for (j = 0; (j < i) && !metrics_same_base( &metrics[j], &metrics[i] ); j++);
+    if (j < i)
+      continue;
+    size_t base = metrics_base( metrics[i].name );
+    fprintf( f, "# HELP %.*s %s\n", (int)base, metrics[i].name, metrics[i].help );
+    fprintf( f, "# TYPE %.*s %s\n", (int)base, metrics[i].name, types[metrics[i].type] );
+    for (j = i; j < count; j++) {
+      if (metrics_same_base( &metrics[j], &metrics[i] ))
+        metrics_print( f, &metrics[j] );
+    }
+  }
+  if ((fclose( f ) != 0) || (rename( tmp, filename ) != 0)) {
+    logging_error( "Could not write metrics file '%s'.\n", filename );
+    return -1;
+  }
+  return 0;
+}
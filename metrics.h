@@ -0,0 +1,75 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H 1
+
+/** registry of counters, gauges and histograms. Metrics are registered
+ * when a module instance is created and updated from the hot path with
+ * relaxed atomics, no locks. Instances registering the same name share
+ * the metric, e.g. all channels count into one rtl868_samples_total.
+ *
+ * metrics_write() dumps all of them in the Prometheus text format, e.g.
+ * for the textfile collector of node_exporter.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define METRICS_MAX 64
+#define METRICS_BUCKETS 16
+
+enum { METRICS_COUNTER, METRICS_GAUGE, METRICS_HISTOGRAM };
+
+typedef struct {
+  /// name with labels, e.g. rtl868_frames_total{protocol="ws300"}
+  const char *name;
+  const char *help;
+  int type;
+  /// counter or gauge value, histogram count
+  atomic_llong value;
+  /// histogram: upper bounds and counts per bucket, sum as double bits
+  const double *bounds;
+  int n_bounds;
+  atomic_llong buckets[METRICS_BUCKETS];
+  atomic_ullong sum;
+} metric_t;
+
+/** find or register a metric, returns 0 if the registry is full. name and
+ * help must be string literals (or live as long) */
+metric_t *metrics_counter( const char *name, const char *help );
+metric_t *metrics_gauge( const char *name, const char *help );
+/// bounds are the n ascending upper bounds, +Inf is added
+metric_t *metrics_histogram( const char *name, const char *help, const double *bounds, int n );
+
+/// updates, all of them accept m == 0
+static inline void metrics_add( metric_t *m, long long n ) {
+  if (m != 0) atomic_fetch_add_explicit( &m->value, n, memory_order_relaxed );
+}
+static inline void metrics_set( metric_t *m, long long v ) {
+  if (m != 0) atomic_store_explicit( &m->value, v, memory_order_relaxed );
+}
+void metrics_observe( metric_t *m, double v );
+
+/** write all metrics to filename, through a temporary file so readers
+ * never see a partial one. returns 0 on success */
+int metrics_write( const char *filename );
+
+#endif
@@ -22,44 +22,94 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "bit_decoder.h"
 #include "stream_decoder.h"
 #include "nrz_decode.h"
 #include "logging.h"
+#include "metrics.h"
+#include "trace.h"
+#include "pool.h"
+#include "sample_rate.h"
 
-/// the minimum number of samples a new level must be
-/// present before it is considered stable
-#define LEVEL_THRESHOLD 2
+/// the minimum time in microseconds a new level must be
+/// present before it is considered stable (2 samples at 75 kS/s)
+#define LEVEL_THRESHOLD_US 27
+/// but at least this many samples, with fewer the level has no hysteresis
+/// and follows the noise at low rates
+#define LEVEL_THRESHOLD_MIN 2
 
-/// maximum number of edges to be able to receive
-/// set to number of bits of max. length transmission
-/// any subsequent edge will be silently ignored
-#define EDGE_TIMES_LEN 256
-/// maximum bittime in histogram to consider for bitlen determination
-#define HIST_LEN 64
-/// averaging of bittimes in histogram
+/// maximum bittime in histogram to consider for bitlen determination,
+/// in microseconds (64 samples at 75 kS/s)
+#define HIST_LEN_US 853
+/// averaging of bittimes in histogram, in bins: the maximum and its
+/// neighbours. A count, so it does not scale with the rate.
 #define HIST_AVG 2
-#define DATA_LEN (EDGE_TIMES_LEN/8)
+/// at most this many histogram bins, so that 32 bit lengths still fit
+/// a Q16 nrz_time_t
+#define HIST_LEN_MAX 1024
 
-stream_decoder_t *nrz_next;
-unsigned int nrz_ok, nrz_err;
+#ifdef NRZ_FIXED
+/* bit length and times in Q16 fixed point, for targets without an FPU */
+typedef int32_t nrz_time_t;
+#define NRZ_Q 16
+/// a time of n samples
+#define NRZ_TIME( n ) ((nrz_time_t)(n) << NRZ_Q)
+/// the whole samples of t
+#define NRZ_FLOOR( t ) ((t) >> NRZ_Q)
+/// n times t, widened so that it cannot overflow
+#define NRZ_TIMES( t, n ) ((int64_t)(t) * (n))
+/// whether t is more than half of bitlen, without doubling t
+#define NRZ_OVER_HALF( t, bitlen ) ((t) > (bitlen) - (t))
+/// arguments for NRZ_FMT, without floating point math
+#define NRZ_LOG( t ) (t) < 0 ? "-" : "", (int)(abs( t ) >> NRZ_Q), (int)(((abs( t ) & ((1 << NRZ_Q) - 1)) * 100) >> NRZ_Q)
+#define NRZ_FMT "%s%i.%02i"
+#else
+typedef float nrz_time_t;
+#define NRZ_TIME( n ) ((nrz_time_t)(n))
+#define NRZ_FLOOR( t ) (t)
+#define NRZ_TIMES( t, n ) ((t) * (n))
+#define NRZ_OVER_HALF( t, bitlen ) (2 * (t) > (bitlen))
+#define NRZ_LOG( t ) (t)
+#define NRZ_FMT "%1.2f"
+#endif
 
-int nrz_init(stream_decoder_t *next) {
+/* state of one nrz decoder */
+typedef struct {
+  stream_decoder_t *next;
+  unsigned int ok, err;
+  metric_t *m_bitlen, *m_ok, *m_err;
+  /// LEVEL_THRESHOLD_US and HIST_LEN_US in samples
+  int level_threshold;
+  unsigned int hist_len;
+  /// histogram of the edge times, hist_len entries
+  unsigned int hist[];
+} nrz_ctx_t;
+
+/// buckets of the bit length histogram, in samples
+static const double nrz_bitlen_bounds[] = { 2, 3, 4, 5, 6, 7, 8, 10, 12, 16, 24, 32 };
+
+int nrz_init(bit_decoder_t *self, stream_decoder_t *next) {
+  nrz_ctx_t *c = self->ctx;
   if (next == 0) return -1;
-  nrz_next = next;
-  nrz_ok = 0;
-  nrz_err = 0;
+  c->next = next;
+  c->ok = 0;
+  c->err = 0;
   logging_info( "NRZ Decoder initialized.\n" );
+  return 0;
 }
 
-int nrz_input(int transmission[], unsigned int length, int noise, int signal) {
+/** decode transmission with the buffers edge_times and data, which hold
+ * edge_times_len edges and data_len bytes, from the pools */
+static int nrz_decode( nrz_ctx_t *c, const int16_t transmission[], unsigned int length, const rx_info_t *rx,
+    unsigned int edge_times[], unsigned int edge_times_len, int data[], unsigned int data_len ) {
+  int noise = rx->noise, signal = rx->signal;
   /* decode the bits in transmission (1 per index) using NRZ */
   logging_verbose( "Got new transmission of length %i.\n", length );
   //
   // 0) convert bits to debounced edge times
   int level_counter = 0;
   int edge_time = 0;
-  unsigned int edge_times[EDGE_TIMES_LEN];
   unsigned int edge_times_i = 0;
   int last_level = 0; // always start with level zero
   int i;
@@ -73,42 +123,42 @@ int nrz_input(int transmission[], unsigned int length, int noise, int signal) {
       level_counter--;
     }
     if (level_counter < 0) level_counter = 0;
-    if (level_counter > LEVEL_THRESHOLD) level_counter = LEVEL_THRESHOLD;
-    if (((last_level == 0) && (level_counter == LEVEL_THRESHOLD)) || ((last_level == 1) && (level_counter == 0))) {
+    if (level_counter > c->level_threshold) level_counter = c->level_threshold;
+    if (((last_level == 0) && (level_counter == c->level_threshold)) || ((last_level == 1) && (level_counter == 0))) {
       // level has changed
       last_level = 1 - last_level;
-      if (edge_times_i >= EDGE_TIMES_LEN) edge_times_i = EDGE_TIMES_LEN - 1;
+      if (edge_times_i >= edge_times_len) edge_times_i = edge_times_len - 1;
       edge_times[edge_times_i++] = edge_time;
       edge_time = 0;
     }
   }
   // the end of transmission is also an edge
-  if (edge_times_i >= EDGE_TIMES_LEN) edge_times_i = EDGE_TIMES_LEN - 1;
+  if (edge_times_i >= edge_times_len) edge_times_i = edge_times_len - 1;
   edge_times[edge_times_i++] = edge_time;
   logging_verbose( "Tranmission contains %i edges.\n", edge_times_i );
   /// 1) convert the edge times to histogram
-  unsigned int hist[HIST_LEN];
-  for (i = 0; i<HIST_LEN; i++) hist[i] = 0;
+  unsigned int *hist = c->hist;
+  for (i = 0; i<c->hist_len; i++) hist[i] = 0;
   /* skip the first edge, start with 1 */
   logging_verbose( "Edges are at times: " );
   for (i = 1; i<edge_times_i; i++) {
-    _logging_verbose( "%i, ", edge_times[i] );
-    if ((edge_times[i] > 0) && (edge_times[i] < HIST_LEN))
+    logging_verbose_cont( "%i, ", edge_times[i] );
+    if ((edge_times[i] > 0) && (edge_times[i] < c->hist_len))
       hist[edge_times[i]]++;
   }
-  _logging_verbose( "\n" );
+  logging_verbose_cont( "\n" );
   /// find the maximum of the histogram as bittime
   unsigned int hist_max = 0;
   unsigned int hist_max_i = 0;
   logging_verbose( "Histogram is: " );
-  for (i = 1; i<HIST_LEN; i++) {
-    _logging_verbose( "%i ", hist[i] );
+  for (i = 1; i<c->hist_len; i++) {
+    logging_verbose_cont( "%i ", hist[i] );
     if (hist[i] > hist_max) {
       hist_max = hist[i];
       hist_max_i = i;
     }
   }
-  _logging_verbose( "\n" );
+  logging_verbose_cont( "\n" );
   if (hist_max_i == 0) {
     logging_warning( "Found no histogram max index.\n" );
     return -2;
@@ -121,7 +171,7 @@ int nrz_input(int transmission[], unsigned int length, int noise, int signal) {
   multbitlen = hist[hist_max_i] * hist_max_i;
   multbitnum = hist[hist_max_i];
   for (i = 1; i < HIST_AVG; i++){
-    if ((hist_max_i + i < HIST_LEN) && (hist_max_i - i > 0)) {
+    if ((hist_max_i + i < c->hist_len) && (hist_max_i - i > 0)) {
       multbitlen += 
         hist[hist_max_i-i] * (hist_max_i - i) +
         hist[hist_max_i+i] * (hist_max_i + i);
@@ -130,38 +180,47 @@ int nrz_input(int transmission[], unsigned int length, int noise, int signal) {
         hist[hist_max_i+i];
     }
   }
-  float bitlen = 1.0 * multbitlen / multbitnum;
-  logging_info( "Tranmission bit length is %1.2f.\n", bitlen );
+#ifdef NRZ_FIXED
+  nrz_time_t bitlen = ((int64_t)multbitlen << NRZ_Q) / multbitnum;
+#else
+  nrz_time_t bitlen = 1.0 * multbitlen / multbitnum;
+#endif
+  logging_info( "Tranmission bit length is " NRZ_FMT ".\n", NRZ_LOG( bitlen ) );
+#ifdef NRZ_FIXED
+  // whole samples, no floating point division per frame
+  metrics_observe( c->m_bitlen, NRZ_FLOOR( bitlen ) );
+#else
+  metrics_observe( c->m_bitlen, bitlen );
+#endif
   /// 2) convert the edges to bits using bitlen
   /* now decode the data */
-  int data[DATA_LEN];
   data[0] = 0;
   unsigned int datai = 0;
   unsigned int datab = 0;
   int level = 0;
-  float t = 0;
+  nrz_time_t t = 0;
   for (i = 1 + (transmission[1] == 1 ? 1 : 0); i < edge_times_i; i++ ) {
     level = 1 - level;
-    if (edge_times[i] > 32*bitlen) {
+    if (edge_times[i] > NRZ_FLOOR( NRZ_TIMES( bitlen, 32 ) )) {
       continue;
     }
-    t = edge_times[i];
-    for (;t > bitlen / 2; t -= bitlen) {
+    t = NRZ_TIME( edge_times[i] );
+    for (;NRZ_OVER_HALF( t, bitlen ); t -= bitlen) {
       data[datai] <<= 1;
       data[datai] |= level;
       datab++;
       if (datab >= 8) {
         datab = 0;
         datai++;
-        if (datai >= DATA_LEN) {
+        if (datai >= data_len) {
           logging_error( "No more memory.\n" );
-          datai = DATA_LEN - 1;
+          datai = data_len - 1;
         }
         data[datai] = 0;
       }
     }
     if (abs(t) > bitlen / 5)
-      logging_info( "Remainder of time is large at bit %i: %1.3f samples at %1.3f bitlen.\n", datai * 8 + datab, t, bitlen );
+      logging_info( "Remainder of time is large at bit %i: " NRZ_FMT " samples at " NRZ_FMT " bitlen.\n", datai * 8 + datab, NRZ_LOG( t ), NRZ_LOG( bitlen ) );
   }
   // shift the last byte so that the first bit starts at MSB
   if (datab != 0) {
@@ -172,23 +231,69 @@ int nrz_input(int transmission[], unsigned int length, int noise, int signal) {
   }
   logging_info( "Transmission has %i bits packed in %i bytes: ", datab + (datai-1)*8, datai );
   for (i = 0; i<datai; i++)
-    _logging_info( "%02x ", data[i] );
-  _logging_info( "\n" );
+    logging_info_cont( "%02x ", data[i] );
+  logging_info_cont( "\n" );
   /// 3) handle to next decoder
-  if (nrz_next->input( data, datai ) == 0)
-    nrz_ok++;
-  else
-    nrz_err++;
+  rx_info_t sliced = *rx;
+  sliced.t_sliced = trace_now();
+  if (c->next->input( c->next, data, datai, &sliced ) == 0) {
+    c->ok++;
+    metrics_add( c->m_ok, 1 );
+  } else {
+    c->err++;
+    metrics_add( c->m_err, 1 );
+  }
   // update status
-  logging_status( 2, "bl=%1.2fS/b tl=%ib nerr=%i nok=%i", bitlen, datab + (datai-1)*8, nrz_err, nrz_ok );
+  logging_status( 2, "bl=" NRZ_FMT "S/b tl=%ib nerr=%i nok=%i", NRZ_LOG( bitlen ), datab + (datai-1)*8, c->err, c->ok );
   return 0;
 }
 
-bit_decoder_t nrz = {
-  .name = "Non-Return-to-Zero decoder for bipolar signals",
-  .shorthand = "nrz",
-  .init = nrz_init,
-  .input = nrz_input
-};
+int nrz_input(bit_decoder_t *self, const int16_t transmission[], unsigned int length, const rx_info_t *rx) {
+  nrz_ctx_t *c = self->ctx;
+  pool_t *edges = pool_class( POOL_EDGES ), *bytes = pool_class( POOL_BYTES );
+  unsigned int *edge_times = pool_get( edges );
+  int *data = pool_get( bytes );
+  int res = -1;
+  if ((edge_times != 0) && (data != 0))
+    res = nrz_decode( c, transmission, length, rx, edge_times, pool_size( edges ) / sizeof(edge_times[0]),
+      data, pool_size( bytes ) / sizeof(data[0]) );
+  else
+    logging_warning( "No buffers for a transmission of %i samples, dropping it.\n", length );
+  pool_put( edges, edge_times );
+  pool_put( bytes, data );
+  return res;
+}
 
+void nrz_destroy(bit_decoder_t *self) {
+  free( self->ctx );
+  free( self );
+}
 
+bit_decoder_t *nrz_create(void) {
+  bit_decoder_t *self = malloc( sizeof(*self) );
+  unsigned int hist_len = srate_samples( HIST_LEN_US );
+  if (hist_len > HIST_LEN_MAX) hist_len = HIST_LEN_MAX;
+  nrz_ctx_t *c = calloc( 1, sizeof(*c) + hist_len * sizeof(c->hist[0]) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a NRZ decoder.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (bit_decoder_t){
+    .name = "Non-Return-to-Zero decoder for bipolar signals",
+    .shorthand = "nrz",
+    .ctx = c,
+    .init = nrz_init,
+    .input = nrz_input,
+    .destroy = nrz_destroy
+  };
+  c->level_threshold = srate_samples( LEVEL_THRESHOLD_US );
+  if (c->level_threshold < LEVEL_THRESHOLD_MIN) c->level_threshold = LEVEL_THRESHOLD_MIN;
+  c->hist_len = hist_len;
+  c->m_bitlen = metrics_histogram( "rtl868_bit_length_samples{decoder=\"nrz\"}", "Estimated bit length of the transmissions.",
+    nrz_bitlen_bounds, sizeof(nrz_bitlen_bounds)/sizeof(nrz_bitlen_bounds[0]) );
+  c->m_ok = metrics_counter( "rtl868_bit_frames_total{decoder=\"nrz\",result=\"ok\"}", "Frames sliced by the bit decoders, by whether a stream decoder took them." );
+  c->m_err = metrics_counter( "rtl868_bit_frames_total{decoder=\"nrz\",result=\"error\"}", "" );
+  return self;
+}
@@ -24,7 +24,7 @@
 #define NRZ_DECODE_H 1
 
 #include "bit_decoder.h"
-extern bit_decoder_t nrz;
+bit_decoder_t *nrz_create( void );
 
 
 #endif
@@ -0,0 +1,359 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/** Streaming Non-Return-to-Zero decoding routine
+ *
+ * Unlike nrz_decode.c this does not need the complete transmission. The
+ * samples are sliced into levels as they arrive, every level change is
+ * turned into bits right away using a bit length estimate which is then
+ * tracked from the timing error of each edge. The initial estimate comes
+ * from the first NRZS_TRAIN edges (the preamble) and is replaced by a bit
+ * length learned from previously decoded frames if one is close enough,
+ * so a sensor that was received before starts with its own bit length.
+ * There is no limit on the number of edges in a frame, its bytes go to a
+ * POOL_BYTES buffer, which holds those of the longest transmission.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bit_decoder.h"
+#include "stream_decoder.h"
+#include "nrz_stream.h"
+#include "logging.h"
+#include "metrics.h"
+#include "trace.h"
+#include "pool.h"
+#include "sample_rate.h"
+
+/// the minimum time in microseconds a new level must be
+/// present before it is considered stable (2 samples at 75 kS/s)
+#define NRZS_LEVEL_THRESHOLD_US 27
+/// but at least this many samples, with fewer the level has no hysteresis
+/// and follows the noise at low rates
+#define NRZS_LEVEL_THRESHOLD_MIN 2
+/// number of edge intervals used for the initial bit length estimate
+#define NRZS_TRAIN 8
+/// number of learned bit lengths
+#define NRZS_RATES 8
+/// a learned bit length is used if it is within this fraction
+/// of the initial estimate
+#define NRZS_SNAP 0.12
+/// gain of the bit length tracker
+#define NRZS_GAIN 0.0625
+/// only intervals of up to this many bits update the bit length
+#define NRZS_TRACK_BITS 2
+/// the tracked bit length stays within this fraction of the initial one
+#define NRZS_TRACK_RANGE 0.05
+
+/* state of one streaming nrz decoder */
+typedef struct {
+  stream_decoder_t *next;
+  unsigned int ok, err;
+  metric_t *m_bitlen, *m_ok, *m_err;
+
+  /// bit lengths of successfully decoded frames
+  float rate[NRZS_RATES];
+  unsigned int rate_hits[NRZS_RATES];
+
+  /* state of the current transmission */
+  int noise;
+  long long sigsum;     ///< sum of the amplitude of all samples so far
+  unsigned int sign;    ///< number of samples so far
+  int level_counter;
+  int level_threshold;  ///< NRZS_LEVEL_THRESHOLD_US in samples
+  int level;
+  unsigned int edge_time;
+  unsigned int edges;
+  unsigned int train[NRZS_TRAIN];
+  unsigned int train_n;
+  float bitlen;         ///< 0 until trained
+  float bitlen0;        ///< bit length after training
+  int rate_i;           ///< learned bit length in use or -1
+  int *data;
+  unsigned int data_len;
+  unsigned int datai;
+  unsigned int datab;
+} nrzs_ctx_t;
+
+/// buckets of the bit length histogram, in samples
+static const double nrzs_bitlen_bounds[] = { 2, 3, 4, 5, 6, 7, 8, 10, 12, 16, 24, 32 };
+
+int nrzs_init(bit_decoder_t *self, stream_decoder_t *next) {
+  nrzs_ctx_t *c = self->ctx;
+  if (next == 0) return -1;
+  c->next = next;
+  c->ok = 0;
+  c->err = 0;
+  memset( c->rate_hits, 0, sizeof(c->rate_hits) );
+  pool_t *bytes = pool_class( POOL_BYTES );
+  if (c->data == 0)
+    c->data = bytes == 0 ? 0 : pool_get( bytes );
+  if (c->data == 0) {
+    logging_error( "Could not get a byte buffer for the NRZ decoder.\n" );
+    return -1;
+  }
+  c->data_len = pool_size( bytes ) / sizeof(c->data[0]);
+  logging_info( "Streaming NRZ Decoder initialized.\n" );
+  return 0;
+}
+
+int nrzs_begin(bit_decoder_t *self, int noise) {
+  nrzs_ctx_t *c = self->ctx;
+  c->noise = noise;
+  c->sigsum = 0;
+  c->sign = 0;
+  c->level_counter = 0;
+  c->level = 0; // always start with level zero
+  c->edge_time = 0;
+  c->edges = 0;
+  c->train_n = 0;
+  c->bitlen = 0;
+  c->rate_i = -1;
+  c->datai = 0;
+  c->datab = 0;
+  c->data[0] = 0;
+  return 0;
+}
+
+static void nrzs_bit( nrzs_ctx_t *c, int level ) {
+  c->data[c->datai] <<= 1;
+  c->data[c->datai] |= level;
+  c->datab++;
+  if (c->datab >= 8) {
+    c->datab = 0;
+    c->datai++;
+    if (c->datai >= c->data_len) {
+      logging_error( "No more memory.\n" );
+      c->datai = c->data_len - 1;
+    }
+    c->data[c->datai] = 0;
+  }
+}
+
+/** turn an interval of dt samples at the given level into bits */
+static void nrzs_slice( nrzs_ctx_t *c, unsigned int dt, int level ) {
+  if (dt > 32*c->bitlen)
+    return;
+  float t = dt;
+  unsigned int n = 0;
+  for (;t > c->bitlen / 2; t -= c->bitlen) {
+    nrzs_bit( c, level );
+    n++;
+  }
+  if ((t > c->bitlen / 5) || (-t > c->bitlen / 5))
+    logging_info( "Remainder of time is large at bit %i: %1.3f samples at %1.3f bitlen.\n", c->datai * 8 + c->datab, t, c->bitlen );
+  // the edge came t samples late (or early): follow it, but only as far
+  // as NRZS_TRACK_RANGE from where we started
+  if ((n > 0) && (n <= NRZS_TRACK_BITS)) {
+    c->bitlen += NRZS_GAIN * t / n;
+    if (c->bitlen > (1 + NRZS_TRACK_RANGE) * c->bitlen0) c->bitlen = (1 + NRZS_TRACK_RANGE) * c->bitlen0;
+    if (c->bitlen < (1 - NRZS_TRACK_RANGE) * c->bitlen0) c->bitlen = (1 - NRZS_TRACK_RANGE) * c->bitlen0;
+  }
+}
+
+/** estimate the bit length from the training intervals and decode them */
+static void nrzs_train_done( nrzs_ctx_t *c ) {
+  unsigned int sorted[NRZS_TRAIN];
+  unsigned int i, j;
+  if (c->train_n == 0) return;
+  // median interval, the preamble makes that a single bit
+  for (i = 0; i < c->train_n; i++) {
+    unsigned int v = c->train[i];
+    for (j = i; (j > 0) && (sorted[j-1] > v); j--)
+      sorted[j] = sorted[j-1];
+    sorted[j] = v;
+  }
+  float median = sorted[c->train_n / 2];
+  // and refine it by all intervals close to a multiple of it
+  unsigned int total = 0, bits = 0;
+  for (i = 0; i < c->train_n; i++) {
+    unsigned int n = (c->train[i] + median / 2) / median;
+    float d = c->train[i] - n * median;
+    if ((n > 0) && (n <= NRZS_TRACK_BITS) && (d < median / 3) && (-d < median / 3)) {
+      total += c->train[i];
+      bits += n;
+    }
+  }
+  c->bitlen = bits > 0 ? 1.0 * total / bits : median;
+  // a sensor we have seen before?
+  float best = NRZS_SNAP;
+  for (i = 0; i < NRZS_RATES; i++) {
+    if (c->rate_hits[i] == 0) continue;
+    float d = (c->rate[i] - c->bitlen) / c->bitlen;
+    if (d < 0) d = -d;
+    if (d < best) {
+      best = d;
+      c->rate_i = i;
+    }
+  }
+  logging_verbose( "Initial bit length is %1.2f, learned %1.2f.\n", c->bitlen, c->rate_i < 0 ? 0.0 : c->rate[c->rate_i] );
+  if (c->rate_i >= 0)
+    c->bitlen = c->rate[c->rate_i];
+  c->bitlen0 = c->bitlen;
+  // the first training interval is level one, they alternate
+  for (i = 0; i < c->train_n; i++)
+    nrzs_slice( c, c->train[i], (i & 1) == 0 );
+}
+
+/** the current level lasted dt samples */
+static void nrzs_interval( nrzs_ctx_t *c, unsigned int dt, int level ) {
+  c->edges++;
+  // the time before the first edge is no data
+  if (c->edges == 1) return;
+  if (c->bitlen == 0) {
+    c->train[c->train_n++] = dt;
+    if (c->train_n >= NRZS_TRAIN)
+      nrzs_train_done( c );
+    return;
+  }
+  nrzs_slice( c, dt, level );
+}
+
+int nrzs_samples(bit_decoder_t *self, const int16_t samples[], unsigned int length) {
+  nrzs_ctx_t *c = self->ctx;
+  unsigned int i;
+  for (i = 0; i < length; i++) {
+    int s = samples[i];
+    // decide half way between noise and the signal seen so far
+    c->sigsum += s < 0 ? -s : s;
+    c->sign++;
+    int threshold = (c->noise + c->sigsum / c->sign) >> 1;
+    c->edge_time++;
+    // decrease or increase the counts for this level
+    if (s > threshold) {
+      c->level_counter++;
+    } else if (s < -threshold) {
+      c->level_counter--;
+    }
+    if (c->level_counter < 0) c->level_counter = 0;
+    if (c->level_counter > c->level_threshold) c->level_counter = c->level_threshold;
+    if (((c->level == 0) && (c->level_counter == c->level_threshold)) || ((c->level == 1) && (c->level_counter == 0))) {
+      // level has changed
+      nrzs_interval( c, c->edge_time, c->level );
+      c->level = 1 - c->level;
+      c->edge_time = 0;
+    }
+  }
+  return 0;
+}
+
+/** remember the bit length of a successfully decoded frame */
+static void nrzs_learn( nrzs_ctx_t *c ) {
+  int i;
+  if (c->rate_i < 0) {
+    // take a free slot or the least used one
+    c->rate_i = 0;
+    for (i = 1; i < NRZS_RATES; i++) {
+      if (c->rate_hits[i] < c->rate_hits[c->rate_i])
+        c->rate_i = i;
+    }
+    c->rate[c->rate_i] = c->bitlen;
+    c->rate_hits[c->rate_i] = 0;
+  } else {
+    c->rate[c->rate_i] += 0.25 * (c->bitlen - c->rate[c->rate_i]);
+  }
+  c->rate_hits[c->rate_i]++;
+}
+
+int nrzs_end(bit_decoder_t *self, int accept, const rx_info_t *rx) {
+  nrzs_ctx_t *c = self->ctx;
+  unsigned int i;
+  if (!accept)
+    return 0;
+  // the end of transmission is also an edge
+  nrzs_interval( c, c->edge_time, c->level );
+  if (c->bitlen == 0)
+    nrzs_train_done( c );
+  if (c->bitlen == 0) {
+    logging_warning( "Found no edges to estimate the bit length.\n" );
+    return -2;
+  }
+  logging_info( "Tranmission bit length is %1.2f after %i edges.\n", c->bitlen, c->edges );
+  metrics_observe( c->m_bitlen, c->bitlen );
+  // shift the last byte so that the first bit starts at MSB
+  unsigned int bits = c->datai * 8 + c->datab;
+  if (c->datab != 0) {
+    for (i = c->datab;(i & 7) != 0; i++) {
+      c->data[c->datai] <<= 1;
+    }
+    c->datai++;
+  }
+  logging_info( "Transmission has %i bits packed in %i bytes: ", bits, c->datai );
+  for (i = 0; i<c->datai; i++)
+    logging_info_cont( "%02x ", c->data[i] );
+  logging_info_cont( "\n" );
+  /// handle to next decoder
+  rx_info_t sliced = *rx;
+  sliced.t_sliced = trace_now();
+  if (c->next->input( c->next, c->data, c->datai, &sliced ) == 0) {
+    c->ok++;
+    metrics_add( c->m_ok, 1 );
+    nrzs_learn( c );
+  } else {
+    c->err++;
+    metrics_add( c->m_err, 1 );
+  }
+  // update status
+  logging_status( 2, "bl=%1.2fS/b tl=%ib nerr=%i nok=%i", c->bitlen, bits, c->err, c->ok );
+  return 0;
+}
+
+int nrzs_input(bit_decoder_t *self, const int16_t transmission[], unsigned int length, const rx_info_t *rx) {
+  nrzs_begin( self, rx->noise );
+  nrzs_samples( self, transmission, length );
+  return nrzs_end( self, 1, rx );
+}
+
+void nrzs_destroy(bit_decoder_t *self) {
+  nrzs_ctx_t *c = self->ctx;
+  if (c->data != 0)
+    pool_put( pool_class( POOL_BYTES ), c->data );
+  free( c );
+  free( self );
+}
+
+bit_decoder_t *nrzs_create(void) {
+  bit_decoder_t *self = malloc( sizeof(*self) );
+  nrzs_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a streaming NRZ decoder.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (bit_decoder_t){
+    .name = "Streaming Non-Return-to-Zero decoder for bipolar signals",
+    .shorthand = "nrzs",
+    .ctx = c,
+    .init = nrzs_init,
+    .input = nrzs_input,
+    .begin = nrzs_begin,
+    .samples = nrzs_samples,
+    .end = nrzs_end,
+    .destroy = nrzs_destroy
+  };
+  c->level_threshold = srate_samples( NRZS_LEVEL_THRESHOLD_US );
+  if (c->level_threshold < NRZS_LEVEL_THRESHOLD_MIN) c->level_threshold = NRZS_LEVEL_THRESHOLD_MIN;
+  c->m_bitlen = metrics_histogram( "rtl868_bit_length_samples{decoder=\"nrzs\"}", "Estimated bit length of the transmissions.",
+    nrzs_bitlen_bounds, sizeof(nrzs_bitlen_bounds)/sizeof(nrzs_bitlen_bounds[0]) );
+  c->m_ok = metrics_counter( "rtl868_bit_frames_total{decoder=\"nrzs\",result=\"ok\"}", "Frames sliced by the bit decoders, by whether a stream decoder took them." );
+  c->m_err = metrics_counter( "rtl868_bit_frames_total{decoder=\"nrzs\",result=\"error\"}", "" );
+  return self;
+}
@@ -0,0 +1,261 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "logging.h"
+#include "outfile.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define OUTFILE_NAME_LEN 1024
+
+/// set by outfile_rotate_request()
+static volatile sig_atomic_t of_rotate = 0;
+
+/* state of one outfile */
+typedef struct {
+  const outfile_params_t *p;
+  data_logger_t *(*create)( void );
+  /// logger writing the current file
+  data_logger_t *inner;
+  FILE *out;
+  char name[OUTFILE_NAME_LEN];
+  /// time of the next rotation by age, 0 if none
+  time_t rotate_at;
+  /// records since the last commit and monotonic time of it
+  unsigned int pending;
+  time_t committed;
+  /// input and tick may run in different threads
+  pthread_mutex_t lock;
+} outfile_ctx_t;
+
+int outfile_sync( const char *name ) {
+  if (strcmp( name, "none" ) == 0) return OUTFILE_SYNC_NONE;
+  if (strcmp( name, "rotate" ) == 0) return OUTFILE_SYNC_ROTATE;
+  if (strcmp( name, "commit" ) == 0) return OUTFILE_SYNC_COMMIT;
+  return -1;
+}
+
+void outfile_rotate_request( void ) {
+  of_rotate = 1;
+}
+
+static time_t of_monotonic( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec;
+}
+
+/** next multiple of the rotation interval after now, in local time so
+ * that daily files start at midnight */
+static time_t of_next_rotation( const outfile_params_t *p, time_t now ) {
+  struct tm lt;
+  if ((p->rotate_interval == 0) || (localtime_r( &now, &lt ) == 0))
+    return 0;
+  time_t local = now + lt.tm_gmtoff;
+  return (local / p->rotate_interval + 1) * p->rotate_interval - lt.tm_gmtoff;
+}
+
+/** write everything buffered to the file */
+static void of_commit( outfile_ctx_t *c ) {
+  if ((c->inner != 0) && (c->inner->flush != 0))
+    c->inner->flush( c->inner );
+  if (c->out != 0) {
+    fflush( c->out );
+    if (c->p->sync == OUTFILE_SYNC_COMMIT)
+      fdatasync( fileno( c->out ) );
+  }
+  c->pending = 0;
+  c->committed = of_monotonic();
+}
+
+static void of_close( outfile_ctx_t *c ) {
+  of_commit( c );
+  if (c->inner != 0) {
+    // the logger may write a trailer
+    c->inner->destroy( c->inner );
+    c->inner = 0;
+  }
+  if (c->out == 0)
+    return;
+  fflush( c->out );
+  if (c->p->sync != OUTFILE_SYNC_NONE)
+    fdatasync( fileno( c->out ) );
+  if (c->out != stdout)
+    fclose( c->out );
+  c->out = 0;
+}
+
+/** open the file named by the pattern now. Files already at the size
+ * limit get a number appended, as the name may not have changed. */
+static int of_open( outfile_ctx_t *c ) {
+  time_t now = time( 0 );
+  struct tm lt;
+  struct stat st;
+  if (strcmp( c->p->pattern, "-" ) == 0) {
+    c->out = stdout;
+    strcpy( c->name, "-" );
+  } else {
+    if ((localtime_r( &now, &lt ) == 0) ||
+        (strftime( c->name, sizeof(c->name), c->p->pattern, &lt ) == 0)) {
+      logging_error( "Could not make a file name from '%s'.\n", c->p->pattern );
+      return -1;
+    }
+    size_t len = strlen( c->name );
+    unsigned int n = 0;
+    int w;
+    while ((c->p->rotate_size != 0) && (stat( c->name, &st ) == 0) && (st.st_size >= (long long)c->p->rotate_size) &&
+        ((w = snprintf( &c->name[len], sizeof(c->name) - len, ".%u", ++n )) >= 0) && ((size_t)w < sizeof(c->name) - len));
+    c->out = fopen( c->name, "a" );
+    if (c->out == 0) {
+      logging_error( "Could not open output file '%s'.\n", c->name );
+      return -1;
+    }
+  }
+  c->inner = c->create();
+  if ((c->inner == 0) || (c->inner->init( c->inner, c->out ) != 0)) {
+    of_close( c );
+    return -1;
+  }
+  c->rotate_at = c->out == stdout ? 0 : of_next_rotation( c->p, now );
+  c->committed = of_monotonic();
+  logging_info( "Writing to '%s'.\n", c->name );
+  return 0;
+}
+
+/** whether the current file is due for rotation */
+static int of_due( outfile_ctx_t *c ) {
+  if (c->out == 0)
+    return 1;
+  if (c->out == stdout)
+    return 0;
+  if (of_rotate)
+    return 1;
+  if ((c->rotate_at != 0) && (time( 0 ) >= c->rotate_at))
+    return 1;
+  if ((c->p->rotate_size != 0) && (ftell( c->out ) >= (long long)c->p->rotate_size))
+    return 1;
+  return 0;
+}
+
+/** start a new file if the current one is due */
+static void of_rotate_due( outfile_ctx_t *c ) {
+  if (of_due( c )) {
+    of_rotate = 0;
+    of_close( c );
+    of_open( c );
+  }
+}
+
+int outfile_init( data_logger_t *self, FILE *out ) {
+  outfile_ctx_t *c = self->ctx;
+  return of_open( c );
+}
+
+int outfile_input( data_logger_t *self, const dl_record_t *r ) {
+  outfile_ctx_t *c = self->ctx;
+  int res = -1;
+  pthread_mutex_lock( &c->lock );
+  of_rotate_due( c );
+  if (c->inner != 0) {
+    res = c->inner->input( c->inner, r );
+    trace_done( &r->rx );
+    c->pending++;
+    if ((c->p->commit_records != 0) && (c->pending >= c->p->commit_records))
+      of_commit( c );
+  }
+  pthread_mutex_unlock( &c->lock );
+  return res;
+}
+
+int outfile_flush( data_logger_t *self ) {
+  outfile_ctx_t *c = self->ctx;
+  pthread_mutex_lock( &c->lock );
+  of_commit( c );
+  pthread_mutex_unlock( &c->lock );
+  return 0;
+}
+
+int outfile_raw( data_logger_t *self, const char *line ) {
+  outfile_ctx_t *c = self->ctx;
+  int res = -1;
+  if (!c->p->raw)
+    return -1;
+  pthread_mutex_lock( &c->lock );
+  of_rotate_due( c );
+  if ((c->out != 0) && (fputs( line, c->out ) >= 0)) {
+    res = 0;
+    c->pending++;
+    if ((c->p->commit_records != 0) && (c->pending >= c->p->commit_records))
+      of_commit( c );
+  }
+  pthread_mutex_unlock( &c->lock );
+  return res;
+}
+
+void outfile_tick( data_logger_t *self ) {
+  outfile_ctx_t *c = self->ctx;
+  pthread_mutex_lock( &c->lock );
+  // quiet sensors must not keep the old file open
+  of_rotate_due( c );
+  if ((c->inner != 0) && (c->inner->tick != 0))
+    c->inner->tick( c->inner );
+  if ((c->pending > 0) && (c->p->commit_interval != 0) &&
+      (of_monotonic() - c->committed >= c->p->commit_interval))
+    of_commit( c );
+  pthread_mutex_unlock( &c->lock );
+}
+
+void outfile_destroy( data_logger_t *self ) {
+  outfile_ctx_t *c = self->ctx;
+  of_close( c );
+  pthread_mutex_destroy( &c->lock );
+  free( c );
+  free( self );
+}
+
+data_logger_t *outfile_create( const outfile_params_t *p, data_logger_t *(*create)( void ) ) {
+  data_logger_t *self = malloc( sizeof(*self) );
+  outfile_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate an output file.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  c->p = p;
+  c->create = create;
+  pthread_mutex_init( &c->lock, 0 );
+  *self = (data_logger_t){
+    .name = "Output file with rotation",
+    .shorthand = "outfile",
+    .ctx = c,
+    .init = outfile_init,
+    .input = outfile_input,
+    .flush = outfile_flush,
+    .destroy = outfile_destroy
+  };
+  return self;
+}
@@ -0,0 +1,72 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef OUTFILE_H
+#define OUTFILE_H 1
+
+/** output file of the data loggers. The file name may hold strftime()
+ * conversions, records are committed in groups and the file is rotated
+ * without stopping the receiver: by age, by size or when
+ * outfile_rotate_request() is called (e.g. on SIGHUP).
+ *
+ * The outfile is itself a data logger. It creates the logger doing the
+ * formatting for every file and hands the records on to it.
+ */
+
+#include "data_logger.h"
+
+/// when data is forced to the disk with fdatasync()
+enum { OUTFILE_SYNC_NONE = 0, OUTFILE_SYNC_ROTATE, OUTFILE_SYNC_COMMIT };
+
+typedef struct {
+  /// file name, may hold strftime() conversions. "-" is stdout
+  const char *pattern;
+  /// commit (flush) after this many records, 0: leave it to the logger
+  unsigned int commit_records;
+  /// commit at least every this many seconds, 0: never by time
+  unsigned int commit_interval;
+  /// OUTFILE_SYNC_*
+  int sync;
+  /// new file every this many seconds, at multiples of it in local time
+  unsigned int rotate_interval;
+  /// new file once it is this large, 0: no limit
+  unsigned long long rotate_size;
+  /// the logger writes text, lines of outfile_raw() may go between its
+  /// records
+  int raw;
+} outfile_params_t;
+
+/// parse a sync policy name (none, rotate, commit), negative if unknown
+int outfile_sync( const char *name );
+/** data logger writing files by p through loggers from create. p must
+ * live as long as the logger. Its init() ignores the file argument and
+ * opens the first file. */
+data_logger_t *outfile_create( const outfile_params_t *p, data_logger_t *(*create)( void ) );
+/** write line to the current file like a record, -1 if the logger does
+ * not write text or the file is not open. Like input, it may rotate. */
+int outfile_raw( data_logger_t *self, const char *line );
+/** rotate, commit and let the logger write out aged blocks if due, call
+ * regularly (e.g. once a second). Unlike input, this may be called from
+ * another thread. */
+void outfile_tick( data_logger_t *self );
+/// start a new file before the next record, safe in signal handlers
+void outfile_rotate_request( void );
+
+#endif
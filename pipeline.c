@@ -0,0 +1,413 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "pipeline.h"
+#include "spsc.h"
+#include "logging.h"
+#include "metrics.h"
+#include "pool.h"
+
+/// number of sample blocks between reader and detection thread
+#define PL_SAMPLE_QUEUE 256
+/// number of transmissions between detection and each worker thread
+#define PL_TRANSMISSION_QUEUE 64
+/// the queued transmissions of each worker hold this many of the longest
+/// ones, see POOL_SAMPLES
+#define PL_POOL_TRANSMISSIONS 8
+/// transmissions decoded but not yet logged, a power of 2. Each worker
+/// has at most PL_TRANSMISSION_QUEUE of them.
+#define PL_REORDER (PIPELINE_WORKERS * PL_TRANSMISSION_QUEUE)
+/// records of one transmission
+#define PL_RECORDS 4
+/// how long an idle thread sleeps before looking at its queue again
+#define PL_IDLE_NS 1000000
+
+typedef struct {
+  int n;
+  long long queued;  ///< monotonic ns when pushed
+  int16_t d[PIPELINE_BLOCK];
+} pl_block_t;
+
+typedef struct {
+  int16_t *samples;
+  unsigned int length;
+  /// pool position after the samples, and order of the transmission
+  unsigned long end;
+  unsigned long seq;
+  rx_info_t rx;
+  long long queued;
+} pl_transmission_t;
+
+/* the records of a transmission, waiting for those of earlier ones */
+typedef struct {
+  int ready;
+  unsigned int n;
+  dl_record_t rec[PL_RECORDS];
+} pl_result_t;
+
+/* one worker thread */
+typedef struct {
+  pthread_t thread;
+  spsc_t transmissions;
+  /// the samples of the queued transmissions, allocated in order at head
+  /// by the detection thread and released in order by the worker
+  int16_t *pool;
+  unsigned long pool_len;
+  unsigned long pool_head;
+  atomic_ulong pool_released;
+  bit_decoder_t *bd;
+  /// with several workers their own decoders, collecting into result
+  stream_decoder_t *dec;
+  data_logger_t log;
+  pl_result_t *result;
+} pl_worker_t;
+
+/// buckets of the queue latency histograms, in seconds
+static const double pl_latency_bounds[] = { 1e-5, 1e-4, 1e-3, 1e-2, 0.1, 1 };
+metric_t *pl_samples_latency;
+metric_t *pl_transmissions_latency;
+metric_t *pl_samples_drops;
+metric_t *pl_transmissions_drops;
+
+spsc_t pl_samples;
+sample_decoder_t *pl_sd;
+int pl_lossless;
+pl_block_t *pl_current;
+/// set once the producer of the respective queue is finished
+atomic_int pl_reader_done;
+atomic_int pl_detector_done;
+pthread_t pl_detector;
+pl_worker_t pl_workers[PIPELINE_WORKERS];
+int pl_n_workers;
+/// worker to try first for the next transmission
+int pl_next_worker;
+/// order of the next transmission queued
+unsigned long pl_seq;
+/* reorder buffer, with several workers: records are handed to pl_out
+ * in the order of their transmissions. pl_queue_input() keeps the
+ * transmissions queued or waiting here to PL_REORDER */
+data_logger_t *pl_out;
+pl_result_t pl_reorder[PL_REORDER];
+atomic_ulong pl_delivered;
+/// a worker is handing results to pl_out, outside of the lock
+int pl_delivering;
+pthread_mutex_t pl_reorder_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long pl_ns( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void pl_idle( void ) {
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = PL_IDLE_NS };
+  nanosleep( &ts, 0 );
+}
+
+static void *pl_detector_main( void *arg ) {
+  while (1) {
+    pl_block_t *b = spsc_pop_slot( &pl_samples );
+    if (b == 0) {
+      if (atomic_load( &pl_reader_done ) && (spsc_depth( &pl_samples ) == 0))
+        break;
+      pl_idle();
+      continue;
+    }
+    metrics_observe( pl_samples_latency, (pl_ns() - b->queued) * 1e-9 );
+    pl_sd->input_block( pl_sd, b->d, b->n );
+    spsc_pop( &pl_samples );
+  }
+  atomic_store( &pl_detector_done, 1 );
+  return 0;
+}
+
+/** collects the records of the transmission a worker decodes */
+static int pl_log_input( data_logger_t *self, const dl_record_t *r ) {
+  pl_worker_t *w = self->ctx;
+  if (w->result->n >= PL_RECORDS) {
+    logging_warning( "More than %i records in a transmission, dropping record of %i.\n", PL_RECORDS, r->sensor_id );
+    return -1;
+  }
+  w->result->rec[w->result->n++] = *r;
+  return 0;
+}
+
+/** the records of transmission seq are complete, hand on all that are
+ * next in order. One worker at a time writes them, without holding the
+ * lock, so a slow output does not block the others; it takes along what
+ * they finish meanwhile. */
+static void pl_reorder_done( unsigned long seq ) {
+  pthread_mutex_lock( &pl_reorder_lock );
+  pl_reorder[seq & (PL_REORDER - 1)].ready = 1;
+  if (pl_delivering) {
+    pthread_mutex_unlock( &pl_reorder_lock );
+    return;
+  }
+  pl_delivering = 1;
+  unsigned long from = atomic_load( &pl_delivered ), to;
+  while (1) {
+    for (to = from; pl_reorder[to & (PL_REORDER - 1)].ready && (to - from < PL_REORDER); to++);
+    if (to == from)
+      break;
+    pthread_mutex_unlock( &pl_reorder_lock );
+    // the slots stay ready, and so unused, until they are delivered
+    for (; from < to; from++) {
+      pl_result_t *res = &pl_reorder[from & (PL_REORDER - 1)];
+      unsigned int i;
+      for (i = 0; i < res->n; i++)
+        pl_out->input( pl_out, &res->rec[i] );
+    }
+    pthread_mutex_lock( &pl_reorder_lock );
+    for (from = atomic_load( &pl_delivered ); from < to; from++)
+      pl_reorder[from & (PL_REORDER - 1)].ready = 0;
+    atomic_store( &pl_delivered, to );
+  }
+  pl_delivering = 0;
+  pthread_mutex_unlock( &pl_reorder_lock );
+}
+
+static void *pl_worker_main( void *arg ) {
+  pl_worker_t *w = arg;
+  while (1) {
+    pl_transmission_t *t = spsc_pop_slot( &w->transmissions );
+    if (t == 0) {
+      if (atomic_load( &pl_detector_done ) && (spsc_depth( &w->transmissions ) == 0))
+        break;
+      pl_idle();
+      continue;
+    }
+    metrics_observe( pl_transmissions_latency, (pl_ns() - t->queued) * 1e-9 );
+    if (pl_out != 0) {
+      w->result = &pl_reorder[t->seq & (PL_REORDER - 1)];
+      w->result->n = 0;
+    }
+    w->bd->input( w->bd, t->samples, t->length, &t->rx );
+    atomic_store_explicit( &w->pool_released, t->end, memory_order_release );
+    if (pl_out != 0)
+      pl_reorder_done( t->seq );
+    spsc_pop( &w->transmissions );
+  }
+  return 0;
+}
+
+/** length contiguous samples from the pool of w, 0 if it is full. end is
+ * set to the position to release once they are used */
+static int16_t *pl_pool_alloc( pl_worker_t *w, unsigned int length, unsigned long *end ) {
+  unsigned long at = w->pool_head;
+  // transmissions do not wrap around, skip the rest of the pool instead
+  if ((at % w->pool_len) + length > w->pool_len)
+    at += w->pool_len - at % w->pool_len;
+  if (at + length - atomic_load_explicit( &w->pool_released, memory_order_acquire ) > w->pool_len)
+    return 0;
+  w->pool_head = *end = at + length;
+  return &w->pool[at % w->pool_len];
+}
+
+int pl_queue_input( bit_decoder_t *self, const int16_t transmission[], unsigned int length, const rx_info_t *rx ) {
+  pl_transmission_t *t = 0;
+  pl_worker_t *w = &pl_workers[pl_next_worker];
+  int i;
+  while (1) {
+    // the results of the workers wait in pl_reorder for those of earlier
+    // transmissions, a worker stuck on one must not let it overflow
+    int room = (pl_out == 0) || (pl_seq - atomic_load( &pl_delivered ) < PL_REORDER);
+    // the first worker with room, starting after the last one used
+    for (i = 0; room && (i < pl_n_workers) && (t == 0); i++) {
+      w = &pl_workers[(pl_next_worker + i) % pl_n_workers];
+      t = spsc_push_slot( &w->transmissions );
+      if ((t != 0) && ((t->samples = pl_pool_alloc( w, length, &t->end )) == 0))
+        t = 0;
+    }
+    // files wait for the workers, live input cannot
+    if ((t != 0) || !pl_lossless)
+      break;
+    pl_idle();
+  }
+  if (t == 0) {
+    spsc_drop( &w->transmissions );
+    metrics_add( pl_transmissions_drops, 1 );
+    logging_warning( "Transmission queue full, dropping transmission of %i samples.\n", length );
+    return -1;
+  }
+  pl_next_worker = (pl_next_worker + i) % pl_n_workers;
+  memcpy( t->samples, transmission, length * sizeof(t->samples[0]) );
+  t->length = length;
+  t->seq = pl_seq++;
+  t->rx = *rx;
+  t->queued = pl_ns();
+  spsc_push( &w->transmissions );
+  return 0;
+}
+
+/// the queues of the workers, one buffer each
+pool_t *pl_pool;
+
+/** start the threads of the pl_n_workers workers set up by the caller */
+static int pl_start( sample_decoder_t *sd, int lossless ) {
+  int i;
+  if (pool_class( POOL_SAMPLES ) == 0)
+    return -1;
+  size_t len = PL_POOL_TRANSMISSIONS * pool_size( pool_class( POOL_SAMPLES ) );
+  if ((pl_pool == 0) && ((pl_pool = pool_create( "queue", len, pl_n_workers )) == 0))
+    return -1;
+  pl_sd = sd;
+  if (sd->init( sd, &pl_queue ) != 0)
+    return -1;
+  pl_lossless = lossless;
+  pl_current = 0;
+  pl_samples_latency = metrics_histogram( "rtl868_queue_latency_seconds{queue=\"samples\"}", "Time items spent in the pipeline queues.",
+    pl_latency_bounds, sizeof(pl_latency_bounds)/sizeof(pl_latency_bounds[0]) );
+  pl_transmissions_latency = metrics_histogram( "rtl868_queue_latency_seconds{queue=\"transmissions\"}", "",
+    pl_latency_bounds, sizeof(pl_latency_bounds)/sizeof(pl_latency_bounds[0]) );
+  pl_samples_drops = metrics_counter( "rtl868_queue_drops_total{queue=\"samples\"}", "Items dropped because a pipeline queue was full." );
+  pl_transmissions_drops = metrics_counter( "rtl868_queue_drops_total{queue=\"transmissions\"}", "" );
+  atomic_init( &pl_reader_done, 0 );
+  atomic_init( &pl_detector_done, 0 );
+  if (spsc_init( &pl_samples, "samples", PL_SAMPLE_QUEUE, sizeof(pl_block_t) ) != 0)
+    return -1;
+  pl_next_worker = 0;
+  pl_seq = 0;
+  atomic_init( &pl_delivered, 0 );
+  pl_delivering = 0;
+  for (i = 0; i < pl_n_workers; i++) {
+    pl_worker_t *w = &pl_workers[i];
+    if (spsc_init( &w->transmissions, "transmissions", PL_TRANSMISSION_QUEUE, sizeof(pl_transmission_t) ) != 0)
+      return -1;
+    w->pool = pool_get( pl_pool );
+    if (w->pool == 0) {
+      logging_error( "Could not get the transmission queue of worker %i.\n", i );
+      return -1;
+    }
+    w->pool_len = len / sizeof(w->pool[0]);
+    w->pool_head = 0;
+    atomic_init( &w->pool_released, 0 );
+  }
+  if (pthread_create( &pl_detector, 0, pl_detector_main, 0 ) != 0) {
+    logging_error( "Could not start pipeline threads.\n" );
+    return -1;
+  }
+  for (i = 0; i < pl_n_workers; i++) {
+    if (pthread_create( &pl_workers[i].thread, 0, pl_worker_main, &pl_workers[i] ) != 0) {
+      logging_error( "Could not start pipeline threads.\n" );
+      return -1;
+    }
+  }
+  logging_info( "Pipeline started with %i workers, %s.\n", pl_n_workers, lossless ? "lossless" : "dropping samples on overflow" );
+  return 0;
+}
+
+int pipeline_start( sample_decoder_t *sd, bit_decoder_t *bd, stream_decoder_t *next, int lossless ) {
+  if ((sd == 0) || (bd == 0) || (next == 0)) return -1;
+  if (bd->init( bd, next ) != 0)
+    return -1;
+  pl_n_workers = 1;
+  pl_workers[0] = (pl_worker_t){ .bd = bd };
+  pl_out = 0;
+  return pl_start( sd, lossless );
+}
+
+int pipeline_start_workers( int workers, sample_decoder_t *sd, bit_decoder_t *(*bd_create)( void ),
+    stream_decoder_t *(*dec_create)( void ), data_logger_t *out, int lossless ) {
+  int i;
+  if ((sd == 0) || (out == 0) || (workers < 1) || (workers > PIPELINE_WORKERS)) return -1;
+  pl_n_workers = workers;
+  pl_out = out;
+  memset( pl_reorder, 0, sizeof(pl_reorder) );
+  for (i = 0; i < workers; i++) {
+    pl_worker_t *w = &pl_workers[i];
+    *w = (pl_worker_t){ .bd = bd_create(), .dec = dec_create() };
+    w->log = (data_logger_t){ .name = "Worker records", .shorthand = "pl_log", .ctx = w, .input = pl_log_input };
+    if ((w->bd == 0) || (w->dec == 0) || (w->dec->init( w->dec, &w->log ) != 0) ||
+        (w->bd->init( w->bd, w->dec ) != 0))
+      return -1;
+  }
+  return pl_start( sd, lossless );
+}
+
+int16_t *pipeline_block( void ) {
+  while (1) {
+    pl_current = spsc_push_slot( &pl_samples );
+    if ((pl_current != 0) || !pl_lossless)
+      break;
+    pl_idle();
+  }
+  return pl_current == 0 ? 0 : pl_current->d;
+}
+
+void pipeline_push( int n ) {
+  if (pl_current == 0) return;
+  pl_current->n = n;
+  pl_current->queued = pl_ns();
+  spsc_push( &pl_samples );
+  pl_current = 0;
+}
+
+void pipeline_drop( int n ) {
+  spsc_drop( &pl_samples );
+  metrics_add( pl_samples_drops, 1 );
+  logging_warning( "Sample queue full, dropping %i samples.\n", n );
+}
+
+void pipeline_stop( void ) {
+  int i;
+  atomic_store( &pl_reader_done, 1 );
+  pthread_join( pl_detector, 0 );
+  logging_info( "Pipeline stopped, queue %s: %lu pushed, %lu dropped, max %u.\n",
+    pl_samples.name, atomic_load( &pl_samples.pushed ), atomic_load( &pl_samples.drops ), atomic_load( &pl_samples.max_depth ) );
+  spsc_free( &pl_samples );
+  for (i = 0; i < pl_n_workers; i++) {
+    pl_worker_t *w = &pl_workers[i];
+    pthread_join( w->thread, 0 );
+    logging_info( "Worker %i stopped, queue %s: %lu pushed, %lu dropped, max %u.\n", i,
+      w->transmissions.name, atomic_load( &w->transmissions.pushed ), atomic_load( &w->transmissions.drops ), atomic_load( &w->transmissions.max_depth ) );
+    spsc_free( &w->transmissions );
+    pool_put( pl_pool, w->pool );
+    // the chains of several workers are ours
+    if (w->dec != 0) {
+      w->bd->destroy( w->bd );
+      w->dec->destroy( w->dec );
+    }
+  }
+}
+
+void pipeline_status( void ) {
+  unsigned int i, depth = 0, max_depth = 0;
+  unsigned long drops = 0;
+  for (i = 0; i < pl_n_workers; i++) {
+    spsc_t *q = &pl_workers[i].transmissions;
+    depth += spsc_depth( q );
+    if (atomic_load( &q->max_depth ) > max_depth) max_depth = atomic_load( &q->max_depth );
+    drops += atomic_load( &q->drops );
+  }
+  logging_status( 4, "sq=%u/%u sd=%lu tq=%u/%u td=%lu",
+    spsc_depth( &pl_samples ), atomic_load( &pl_samples.max_depth ), atomic_load( &pl_samples.drops ),
+    depth, max_depth, drops );
+}
+
+bit_decoder_t pl_queue = {
+  .name = "Queue to the worker thread",
+  .shorthand = "pl_queue",
+  .init = 0,
+  .input = pl_queue_input
+};
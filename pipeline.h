@@ -0,0 +1,71 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H 1
+
+/** threaded mode: the caller reads sample blocks, a detection thread runs
+ * the sample decoder and a worker thread runs the bit decoder with
+ * everything behind it. The stages are connected by spsc queues, so a
+ * stalled output never blocks reading the input.
+ *
+ * Transmissions can also be decoded by several workers, each with its
+ * own queue and chain of decoders. Their records are put back into the
+ * order of the transmissions before they are logged.
+ */
+
+#include "sample_decoder.h"
+#include "bit_decoder.h"
+#include "data_logger.h"
+
+/// number of samples in one block handed to the detection thread
+#define PIPELINE_BLOCK 1024
+/// most worker threads, a power of 2
+#define PIPELINE_WORKERS 16
+
+/// bit decoder that queues transmissions for the worker thread,
+/// pipeline_start() makes it the next stage of the sample decoder.
+extern bit_decoder_t pl_queue;
+
+/** initialize sd and bd, which passes its frames to next, and start the
+ * detection thread feeding sd and the worker thread feeding bd.
+ * if lossless is set, pipeline_block() waits for a free block and the
+ * detection thread for room in the queues of the workers instead of
+ * dropping, which is what you want when reading from a file.
+ */
+int pipeline_start( sample_decoder_t *sd, bit_decoder_t *bd, stream_decoder_t *next, int lossless );
+/** like pipeline_start(), but with workers worker threads. Every worker
+ * gets a bit decoder and decoders behind it from the create functions,
+ * their records are handed to out in the order of the transmissions.
+ */
+int pipeline_start_workers( int workers, sample_decoder_t *sd, bit_decoder_t *(*bd_create)( void ),
+  stream_decoder_t *(*dec_create)( void ), data_logger_t *out, int lossless );
+/// free block of PIPELINE_BLOCK samples or 0 if the queue is full
+int16_t *pipeline_block( void );
+/// queue the block returned by pipeline_block() holding n samples
+void pipeline_push( int n );
+/// account for n samples that were read but could not be queued
+void pipeline_drop( int n );
+/// process everything queued so far and stop the threads
+void pipeline_stop( void );
+/// put queue depths and drop counters into the status line
+void pipeline_status( void );
+
+#endif
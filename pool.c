@@ -0,0 +1,176 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "logging.h"
+#include "pool.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/// most pools
+#define POOL_MAX 16
+#define POOL_METRIC_LEN 80
+
+struct pool {
+  const char *name;
+  size_t size;
+  unsigned int count;
+  unsigned char *mem;
+  /// stack of the free buffers
+  void **free;
+  unsigned int n_free;
+  /// decoders of several threads share the pools
+  pthread_mutex_t lock;
+  // statistics
+  unsigned int hwm;
+  unsigned long exhausted;
+  metric_t *m_hwm, *m_exhausted;
+  char m_hwm_name[POOL_METRIC_LEN], m_exhausted_name[POOL_METRIC_LEN];
+};
+
+static pool_t pools[POOL_MAX];
+static int n_pools = 0;
+static size_t pool_limit = 0, pool_used = 0;
+static pool_t *pool_classes[POOL_CLASSES];
+
+void pool_budget( size_t bytes ) {
+  pool_limit = bytes;
+}
+
+pool_t *pool_create( const char *name, size_t size, unsigned int count ) {
+  unsigned int i;
+  // keep the buffers aligned for any type
+  size = (size + sizeof(long long) - 1) & ~(sizeof(long long) - 1);
+  size_t bytes = size * count + count * sizeof(void *);
+  if (n_pools >= POOL_MAX) {
+    logging_error( "Too many pools, no room for %s.\n", name );
+    return 0;
+  }
+  if ((pool_limit != 0) && (pool_used + bytes > pool_limit)) {
+    logging_error( "Pool %s of %u * %lu bytes exceeds the memory budget, %lu of %lu bytes are in use.\n",
+      name, count, (unsigned long)size, (unsigned long)pool_used, (unsigned long)pool_limit );
+    return 0;
+  }
+  pool_t *p = &pools[n_pools];
+  p->mem = malloc( size * count );
+  p->free = malloc( count * sizeof(p->free[0]) );
+  if ((p->mem == 0) || (p->free == 0)) {
+    logging_error( "Could not allocate pool %s of %u * %lu bytes.\n", name, count, (unsigned long)size );
+    free( p->mem );
+    free( p->free );
+    return 0;
+  }
+  p->name = name;
+  p->size = size;
+  p->count = count;
+  for (i = 0; i < count; i++)
+    p->free[i] = p->mem + (count - 1 - i) * size;
+  p->n_free = count;
+  p->hwm = 0;
+  p->exhausted = 0;
+  pthread_mutex_init( &p->lock, 0 );
+  snprintf( p->m_hwm_name, sizeof(p->m_hwm_name), "rtl868_pool_high_water{pool=\"%s\"}", name );
+  snprintf( p->m_exhausted_name, sizeof(p->m_exhausted_name), "rtl868_pool_exhausted_total{pool=\"%s\"}", name );
+  p->m_hwm = metrics_gauge( p->m_hwm_name, "Most buffers of a pool in use at a time." );
+  p->m_exhausted = metrics_counter( p->m_exhausted_name, "Buffers not available because their pool was empty." );
+  n_pools++;
+  pool_used += bytes;
+  logging_verbose( "Pool %s: %u buffers of %lu bytes.\n", name, count, (unsigned long)size );
+  return p;
+}
+
+void *pool_get( pool_t *p ) {
+  void *buf = 0;
+  pthread_mutex_lock( &p->lock );
+  if (p->n_free > 0) {
+    buf = p->free[--p->n_free];
+    if (p->count - p->n_free > p->hwm) {
+      p->hwm = p->count - p->n_free;
+      metrics_set( p->m_hwm, p->hwm );
+    }
+  } else {
+    p->exhausted++;
+    metrics_add( p->m_exhausted, 1 );
+  }
+  pthread_mutex_unlock( &p->lock );
+  if (buf == 0)
+    logging_warning( "Pool %s is exhausted.\n", p->name );
+  return buf;
+}
+
+void pool_put( pool_t *p, void *buf ) {
+  if (buf == 0) return;
+  pthread_mutex_lock( &p->lock );
+  p->free[p->n_free++] = buf;
+  pthread_mutex_unlock( &p->lock );
+}
+
+size_t pool_size( const pool_t *p ) {
+  return p->size;
+}
+
+int pool_chain( double rate, unsigned int chains ) {
+  // a transmission fills the ring of its decoder at most, which is a
+  // power of two and holds every sample twice
+  unsigned int samples = 1;
+  while (samples < rate * POOL_TRANSMISSION_SECONDS) samples *= 2;
+  unsigned int edges = (unsigned long long)samples * POOL_BIT_RATE / rate + 1;
+  if (chains == 0) chains = 1;
+  // a burst replay holds one more transmission
+  pool_classes[POOL_RING] = pool_create( "ring", 2 * samples * sizeof(short), chains );
+  pool_classes[POOL_SAMPLES] = pool_create( "samples", samples * sizeof(short), chains + 1 );
+  pool_classes[POOL_EDGES] = pool_create( "edges", edges * sizeof(unsigned int), chains );
+  pool_classes[POOL_BYTES] = pool_create( "bytes", (edges / 4 + 1) * sizeof(int), chains );
+  if ((pool_classes[POOL_RING] == 0) || (pool_classes[POOL_SAMPLES] == 0) ||
+      (pool_classes[POOL_EDGES] == 0) || (pool_classes[POOL_BYTES] == 0))
+    return -1;
+  logging_info( "Pools for %u chains at %1.0f S/s: transmissions of %u samples, %u edges, %lu bytes in use.\n",
+    chains, rate, samples, edges, (unsigned long)pool_used );
+  return 0;
+}
+
+pool_t *pool_class( int cls ) {
+  return pool_classes[cls];
+}
+
+void pool_report( void ) {
+  int i;
+  for (i = 0; i < n_pools; i++) {
+    pool_t *p = &pools[i];
+    pthread_mutex_lock( &p->lock );
+    logging_info( "Pool %s: at most %u of %u buffers of %lu bytes in use, exhausted %lu times.\n",
+      p->name, p->hwm, p->count, (unsigned long)p->size, p->exhausted );
+    pthread_mutex_unlock( &p->lock );
+  }
+}
+
+void pool_free( void ) {
+  int i;
+  for (i = 0; i < n_pools; i++) {
+    free( pools[i].mem );
+    free( pools[i].free );
+    pthread_mutex_destroy( &pools[i].lock );
+  }
+  for (i = 0; i < POOL_CLASSES; i++)
+    pool_classes[i] = 0;
+  n_pools = 0;
+  pool_used = 0;
+}
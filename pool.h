@@ -0,0 +1,75 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef POOL_H
+#define POOL_H 1
+
+/** preallocated buffers. A pool holds a fixed number of buffers of one
+ * size, allocated in one piece when it is created and handed out without
+ * malloc, so the memory of the receiver is bounded once it runs. All pools
+ * together stay within the budget set with pool_budget().
+ *
+ * The decoder chain takes its buffers from the pools of pool_chain(),
+ * whose sizes follow from the sample rate: the samples of the longest
+ * transmission, its edges and its bytes.
+ */
+
+#include <stddef.h>
+
+typedef struct pool pool_t;
+
+/// buffers of the decoder chain
+enum {
+  POOL_RING,     ///< sample ring of a transmission decoder
+  POOL_SAMPLES,  ///< samples of one transmission
+  POOL_EDGES,    ///< edge times (unsigned int) of one transmission
+  POOL_BYTES,    ///< bytes (int) of one transmission
+  POOL_CLASSES
+};
+
+/// the longest transmission kept, in seconds. Rounded up to a power of two
+/// of samples.
+#define POOL_TRANSMISSION_SECONDS 0.5
+/// highest bit rate of the protocols in bit/s, for the number of edges
+#define POOL_BIT_RATE 20000
+
+/// limit all pools to bytes, 0 for no limit. Call before creating pools.
+void pool_budget( size_t bytes );
+/** pool of count buffers of size bytes, 0 if they do not fit the budget.
+ * name must be a string literal (or live as long). */
+pool_t *pool_create( const char *name, size_t size, unsigned int count );
+/// a free buffer, 0 if all are in use
+void *pool_get( pool_t *p );
+/// return a buffer of pool_get(), accepts 0
+void pool_put( pool_t *p, void *buf );
+/// the size of the buffers of p in bytes
+size_t pool_size( const pool_t *p );
+
+/** create the pools of the decoder chain for rate samples per second and
+ * chains decoder chains running at a time. returns 0 on success */
+int pool_chain( double rate, unsigned int chains );
+/// pool of the decoder chain, 0 if pool_chain() was not called
+pool_t *pool_class( int cls );
+/// log the use of all pools, e.g. to find the budget needed
+void pool_report( void );
+/// free all pools, once no buffer is used anymore
+void pool_free( void );
+
+#endif
@@ -0,0 +1,283 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "replay.h"
+#include "logging.h"
+#include "sample_clock.h"
+
+/// input samples fed to the sample decoder at once. The position of a
+/// record is the end of the chunk it was decoded in.
+#define RP_CHUNK 4096
+/// a parallel segment starts decoding this many samples before its
+/// first own sample, so the noise floor has settled and transmissions
+/// crossing the border are complete. Must be a multiple of RP_CHUNK.
+#define RP_WARMUP (1<<19)
+/// maximum number of parallel segments
+#define RP_JOBS 64
+
+const uint8_t *rp_data;
+size_t rp_bytes;
+size_t rp_sample_size;
+
+int replay_open( const char *filename, size_t sample_size ) {
+  int fd = open( filename, O_RDONLY );
+  struct stat st;
+  if ((fd < 0) || (fstat( fd, &st ) != 0)) {
+    logging_error( "Could not open '%s' for replay.\n", filename );
+    if (fd >= 0) close( fd );
+    return -1;
+  }
+  rp_sample_size = sample_size;
+  rp_bytes = st.st_size - st.st_size % sample_size;
+  if (rp_bytes == 0) {
+    logging_error( "Nothing to replay in '%s'.\n", filename );
+    close( fd );
+    return -1;
+  }
+  void *p = mmap( 0, rp_bytes, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if (p == MAP_FAILED) {
+    logging_error( "Could not map '%s'.\n", filename );
+    return -1;
+  }
+  madvise( p, rp_bytes, MADV_SEQUENTIAL );
+  rp_data = p;
+  logging_info( "Replaying %lu samples from '%s'.\n", (unsigned long)(rp_bytes / sample_size), filename );
+  return 0;
+}
+
+void replay_close( void ) {
+  if (rp_data != 0)
+    munmap( (void *)rp_data, rp_bytes );
+  rp_data = 0;
+}
+
+const void *replay_data( void ) {
+  return rp_data;
+}
+
+size_t replay_samples( void ) {
+  return rp_bytes / rp_sample_size;
+}
+
+static double rp_now( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void rp_status( double t0, size_t done ) {
+  double dt = rp_now() - t0;
+  logging_status( 0, "replay %1.0f%%, %1.1fMS/s", 100.0 * done / replay_samples(), dt > 0 ? done / dt / 1e6 : 0.0 );
+  logging_restatus();
+}
+
+/** decode samples [from, to) with sd, through fm if not 0.
+ * *pos is set to the end of every chunk before it is decoded. */
+static void rp_decode( sample_decoder_t *sd, fm_demod_t *fm, int16_t *buf, size_t from, size_t to, atomic_size_t *pos ) {
+  size_t i;
+  for (i = from; i < to; i += RP_CHUNK) {
+    size_t n = to - i < RP_CHUNK ? to - i : RP_CHUNK;
+    atomic_store( pos, i + n );
+    const void *p = rp_data + i * rp_sample_size;
+    if (fm != 0)
+      sd->input_block( sd, buf, fm_demod( fm, p, n, buf ) );
+    else
+      sd->input_block( sd, p, n );
+  }
+}
+
+int replay_run( sample_decoder_t *sd, fm_demod_t *fm ) {
+  int16_t buf[RP_CHUNK + 1];
+  size_t i, total = replay_samples();
+  atomic_size_t pos;
+  double t0 = rp_now(), last = t0;
+  // a megasample at a time, so the status is updated while decoding
+  for (i = 0; i < total; i += 256 * RP_CHUNK) {
+    rp_decode( sd, fm, buf, i, total - i < 256 * RP_CHUNK ? total : i + 256 * RP_CHUNK, &pos );
+    if (rp_now() - last >= 1) {
+      last = rp_now();
+      rp_status( t0, atomic_load( &pos ) );
+    }
+  }
+  double dt = rp_now() - t0;
+  logging_info( "Replayed %lu samples in %1.2fs, %1.1fMS/s.\n", (unsigned long)total, dt, dt > 0 ? total / dt / 1e6 : 0.0 );
+  return 0;
+}
+
+/* parallel replay */
+
+typedef struct {
+  unsigned long long offset;
+  dl_record_t r;
+} rp_record_t;
+
+typedef struct {
+  /// own samples are (lo, hi], decoding starts at from
+  size_t from, lo, hi;
+  atomic_size_t pos;
+  sample_decoder_t *sd;
+  bit_decoder_t *bd;
+  stream_decoder_t *dec;
+  data_logger_t log;
+  fm_demod_t fm;
+  int iq;
+  rp_record_t *records;
+  size_t n, len;
+  pthread_t thread;
+} rp_segment_t;
+
+/** data logger of a segment, keeps the records of its own samples */
+int rp_log_input( data_logger_t *self, const dl_record_t *r ) {
+  rp_segment_t *s = self->ctx;
+  size_t pos = atomic_load( &s->pos );
+  if ((pos <= s->lo) || (pos > s->hi))
+    return 0;
+  if (s->n >= s->len) {
+    size_t len = s->len ? 2 * s->len : 64;
+    rp_record_t *r = realloc( s->records, len * sizeof(r[0]) );
+    if (r == 0) {
+      logging_error( "Could not allocate %lu replay records.\n", (unsigned long)len );
+      return -1;
+    }
+    s->records = r;
+    s->len = len;
+  }
+  // the decoders of the segment count samples from its start
+  rp_record_t *rec = &s->records[s->n++];
+  *rec = (rp_record_t){ pos, *r };
+  rec->r.rx.sample += s->from / (s->iq ? fm_demod_decimation( &s->fm ) : 1);
+  rec->r.time = sclock_time( rec->r.rx.sample );
+  return 0;
+}
+
+/** where a segment starting at lo starts decoding, the warmup is counted
+ * in decoded samples */
+static size_t rp_warmup( size_t lo, unsigned int decimation ) {
+  size_t warmup = (size_t)RP_WARMUP * decimation;
+  return lo > warmup ? lo - warmup : 0;
+}
+
+static void *rp_segment_main( void *arg ) {
+  rp_segment_t *s = arg;
+  int16_t buf[RP_CHUNK + 1];
+  rp_decode( s->sd, s->iq ? &s->fm : 0, buf, s->from, s->hi, &s->pos );
+  return 0;
+}
+
+int replay_run_parallel( int jobs, int iq_format, unsigned int rate,
+    sample_decoder_t *(*sd_create)( void ), bit_decoder_t *(*bd_create)( void ),
+    stream_decoder_t *(*dec_create)( void ), data_logger_t *out ) {
+  rp_segment_t *seg;
+  size_t total = replay_samples();
+  int i, res = 0;
+  if (jobs > RP_JOBS) jobs = RP_JOBS;
+  // segments are whole chunks, so all of them see the same chunk borders
+  size_t len = (total + jobs - 1) / jobs;
+  len = (len + RP_CHUNK - 1) / RP_CHUNK * RP_CHUNK;
+  seg = calloc( jobs, sizeof(seg[0]) );
+  if (seg == 0) return -1;
+  double t0 = rp_now();
+  for (i = 0; i < jobs; i++) {
+    rp_segment_t *s = &seg[i];
+    s->lo = i * len < total ? i * len : total;
+    s->hi = s->lo + len < total ? s->lo + len : total;
+    s->log = (data_logger_t){ .name = "Replay segment", .shorthand = "rp_log", .ctx = s, .input = rp_log_input };
+    s->iq = iq_format >= 0;
+    s->sd = sd_create();
+    s->bd = bd_create();
+    s->dec = dec_create();
+    if ((s->sd == 0) || (s->bd == 0) || (s->dec == 0) ||
+        (s->iq && (fm_demod_init( &s->fm, iq_format, rate, 0, RP_CHUNK ) != 0)) ||
+        (s->sd->init( s->sd, s->bd ) != 0) || (s->bd->init( s->bd, s->dec ) != 0) ||
+        (s->dec->init( s->dec, &s->log ) != 0)) {
+      jobs = i + 1;
+      res = -1;
+      break;
+    }
+    s->from = rp_warmup( s->lo, s->iq ? fm_demod_decimation( &s->fm ) : 1 );
+  }
+  if (res == 0) {
+    for (i = 0; i < jobs; i++) {
+      if (pthread_create( &seg[i].thread, 0, rp_segment_main, &seg[i] ) != 0) {
+        logging_error( "Could not start replay threads.\n" );
+        res = -1;
+        break;
+      }
+    }
+    // the segments already started finish, their records are dropped
+    if (res != 0) {
+      int started = i;
+      for (i = 0; i < started; i++)
+        pthread_join( seg[i].thread, 0 );
+    }
+  }
+  if (res == 0) {
+    logging_info( "Replaying in %i segments of %lu samples.\n", jobs, (unsigned long)len );
+    // show the progress until all are done
+    int running = jobs;
+    while (running > 0) {
+      struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000000 };
+      nanosleep( &ts, 0 );
+      size_t done = 0;
+      running = 0;
+      for (i = 0; i < jobs; i++) {
+        size_t pos = atomic_load( &seg[i].pos );
+        done += pos > seg[i].lo ? pos - seg[i].lo : 0;
+        running += pos < seg[i].hi;
+      }
+      rp_status( t0, done );
+    }
+    size_t n = 0;
+    for (i = 0; i < jobs; i++) {
+      pthread_join( seg[i].thread, 0 );
+      // segments are in file order, so are their records
+      size_t j;
+      for (j = 0; j < seg[i].n; j++) {
+        out->input( out, &seg[i].records[j].r );
+      }
+      n += seg[i].n;
+    }
+    double dt = rp_now() - t0;
+    logging_info( "Replayed %lu samples in %1.2fs, %1.1fMS/s, %lu records.\n", (unsigned long)total, dt,
+      dt > 0 ? total / dt / 1e6 : 0.0, (unsigned long)n );
+  }
+  for (i = 0; i < jobs; i++) {
+    rp_segment_t *s = &seg[i];
+    if (s->sd != 0) s->sd->destroy( s->sd );
+    if (s->bd != 0) s->bd->destroy( s->bd );
+    if (s->dec != 0) s->dec->destroy( s->dec );
+    if (s->iq) fm_demod_free( &s->fm );
+    free( s->records );
+  }
+  free( seg );
+  return res;
+}
@@ -0,0 +1,55 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H 1
+
+/** replay of recorded captures. The file is mapped into memory and fed
+ * to the sample decoder without copying (S16LE) or through the FM
+ * demodulator (IQ). Several segments of the file can be decoded in
+ * parallel, each by its own signal chain, the records are then merged
+ * by their position in the file.
+ */
+
+#include <stddef.h>
+#include "sample_decoder.h"
+#include "bit_decoder.h"
+#include "stream_decoder.h"
+#include "data_logger.h"
+#include "fm_demod.h"
+
+/// map filename holding samples of sample_size bytes, returns 0 on success
+int replay_open( const char *filename, size_t sample_size );
+void replay_close( void );
+/// the mapped samples and their number
+const void *replay_data( void );
+size_t replay_samples( void );
+/** feed the whole file to sd, through fm if that is not 0 */
+int replay_run( sample_decoder_t *sd, fm_demod_t *fm );
+/** decode the file in jobs segments in parallel. Every segment gets its
+ * own chain from the create functions, iq_format < 0 means S16LE input.
+ * The records are handed to out in the order of the file. returns 0 on
+ * success.
+ */
+int replay_run_parallel( int jobs, int iq_format, unsigned int rate,
+  sample_decoder_t *(*sd_create)( void ), bit_decoder_t *(*bd_create)( void ),
+  stream_decoder_t *(*dec_create)( void ), data_logger_t *out );
+
+#endif
@@ -0,0 +1,39 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef RX_INFO_H
+#define RX_INFO_H 1
+
+/** what the receiver knows about a transmission. The sample decoder
+ * fills it in when it hands the transmission on, the following stages
+ * pass it along to the data logger and add their trace stamps.
+ */
+typedef struct {
+  int noise;   ///< noise floor before the transmission
+  int signal;  ///< mean amplitude of the transmission
+  /// number of the transmission's first sample in the input
+  unsigned long long sample;
+  /// CLOCK_MONOTONIC ns at detection, when the sample decoder handed the
+  /// transmission on, when it was sliced into bits and when a protocol
+  /// decoder made a record of it. 0 unless tracing is enabled.
+  long long t_detect, t_cut, t_sliced, t_decoded;
+} rx_info_t;
+
+#endif
@@ -0,0 +1,86 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "sample_clock.h"
+#include "logging.h"
+#include <stdatomic.h>
+#include <time.h>
+
+/// a difference of more than this (ns) to the wall clock is stepped
+#define SCLOCK_STEP 1000000000LL
+/// smaller ones are corrected by this fraction on every update
+#define SCLOCK_SLEW 8
+
+/* the anchor, written by the reader and read by the loggers. A sequence
+ * lock: odd while an update is in progress */
+static atomic_uint sc_seq;
+static atomic_ullong sc_sample;
+static atomic_llong sc_ns;
+static double sc_ns_per_sample;
+static atomic_int sc_started;
+
+static long long sclock_realtime( void ) {
+  struct timespec ts;
+  clock_gettime( CLOCK_REALTIME, &ts );
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sclock_anchor( unsigned long long sample, long long ns ) {
+  unsigned int seq = atomic_load_explicit( &sc_seq, memory_order_relaxed );
+  atomic_store_explicit( &sc_seq, seq + 1, memory_order_relaxed );
+  atomic_thread_fence( memory_order_release );
+  atomic_store_explicit( &sc_sample, sample, memory_order_relaxed );
+  atomic_store_explicit( &sc_ns, ns, memory_order_relaxed );
+  atomic_store_explicit( &sc_seq, seq + 2, memory_order_release );
+}
+
+void sclock_start( double rate, long long epoch_ns ) {
+  sc_ns_per_sample = 1e9 / rate;
+  sclock_anchor( 0, epoch_ns != 0 ? epoch_ns : sclock_realtime() );
+  atomic_store( &sc_started, 1 );
+  logging_verbose( "Sample clock started at %1.0f S/s.\n", rate );
+}
+
+long long sclock_time( unsigned long long sample ) {
+  unsigned long long s;
+  long long ns;
+  unsigned int seq;
+  if (!atomic_load_explicit( &sc_started, memory_order_acquire ))
+    return sclock_realtime();
+  do {
+    seq = atomic_load_explicit( &sc_seq, memory_order_acquire );
+    s = atomic_load_explicit( &sc_sample, memory_order_relaxed );
+    ns = atomic_load_explicit( &sc_ns, memory_order_relaxed );
+    atomic_thread_fence( memory_order_acquire );
+  } while ((seq & 1) || (seq != atomic_load_explicit( &sc_seq, memory_order_relaxed )));
+  return ns + (long long)(((double)sample - (double)s) * sc_ns_per_sample);
+}
+
+void sclock_update( unsigned long long samples ) {
+  long long now = sclock_realtime();
+  long long predicted = sclock_time( samples );
+  long long err = now - predicted;
+  if ((err > SCLOCK_STEP) || (err < -SCLOCK_STEP)) {
+    logging_warning( "Sample clock is off by %1.3fs, stepping it.\n", err * 1e-9 );
+    sclock_anchor( samples, now );
+  } else {
+    sclock_anchor( samples, predicted + err / SCLOCK_SLEW );
+  }
+}
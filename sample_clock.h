@@ -0,0 +1,40 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H 1
+
+/** wall clock time of samples. Records are stamped with the time of the
+ * sample their transmission started at, so queueing or a slow output
+ * does not shift them. The sample clock is anchored to CLOCK_REALTIME
+ * when the input starts and, for live input, re-anchored as samples are
+ * read. Small differences are corrected gradually, large ones (e.g.
+ * after lost samples) at once.
+ */
+
+/** sample 0 is at epoch_ns since the epoch, or now if that is 0. rate
+ * is in samples per second */
+void sclock_start( double rate, long long epoch_ns );
+/// samples have been read up to now, correct the anchor
+void sclock_update( unsigned long long samples );
+/// ns since the epoch of sample, or now if the clock is not started
+long long sclock_time( unsigned long long sample );
+
+#endif
@@ -24,15 +24,24 @@
 
 #include "bit_decoder.h"
 #include <stdint.h>
+#include <stddef.h>
 
-/* interface for sample decoder */
-typedef struct {
+/* interface for sample decoder. Instances are made by the module's
+ * create function (e.g. td_create()), own their state in ctx and are
+ * freed by destroy(). */
+typedef struct sample_decoder sample_decoder_t;
+struct sample_decoder {
   char *name;
   char *shorthand;
+  void *ctx;  ///< state of this instance
   // interface
-  int (*init)(bit_decoder_t *next);
-  int (*input)(int16_t sample);
-} sample_decoder_t;
+  int (*init)(sample_decoder_t *self, bit_decoder_t *next);
+  int (*input)(sample_decoder_t *self, int16_t sample);
+  /// same as calling input() for every sample, but only leaves its
+  /// inner loop at transmission boundaries
+  int (*input_block)(sample_decoder_t *self, const int16_t samples[], size_t length);
+  void (*destroy)(sample_decoder_t *self);
+};
 
 
 
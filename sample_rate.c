@@ -0,0 +1,38 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "sample_rate.h"
+#include "logging.h"
+
+static double sr_rate = SRATE_DEFAULT;
+
+void srate_set( double rate ) {
+  sr_rate = rate;
+  logging_verbose( "Decoders run at %1.0f S/s.\n", rate );
+}
+
+double srate_get( void ) {
+  return sr_rate;
+}
+
+unsigned int srate_samples( unsigned int us ) {
+  unsigned int n = (unsigned int)(us * sr_rate / 1e6 + 0.5);
+  return n > 0 ? n : 1;
+}
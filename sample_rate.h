@@ -0,0 +1,40 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SAMPLE_RATE_H
+#define SAMPLE_RATE_H 1
+
+/** sample rate of the decoder chains. The transmission and bit decoders
+ * keep their time constants in microseconds and convert them to samples
+ * at this rate when they are created, so one build decodes input of any
+ * rate. All chains of a run share the rate; set it before creating them.
+ */
+
+/// the rate used unless srate_set() is called, that of rtl_fm in
+/// temp-daemon.sh
+#define SRATE_DEFAULT 75000
+
+/// rate in samples per second
+void srate_set( double rate );
+double srate_get( void );
+/// us microseconds in samples, rounded and at least 1
+unsigned int srate_samples( unsigned int us );
+
+#endif
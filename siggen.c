@@ -0,0 +1,177 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "siggen.h"
+#include "tools.h"
+#include "logging.h"
+
+/// samples per bit at 75 kS/s of the nominal bit rates
+#define SIGGEN_WS300_SPB 7.83
+#define SIGGEN_TX29_SPB 4.35
+/// noise before the first frame, so the noise floor has settled
+#define SIGGEN_LEAD 100000
+/// shortest gap between frames
+#define SIGGEN_MIN_GAP 2000
+
+void siggen_defaults( siggen_params_t *p ) {
+  p->rate = 75000;
+  p->frames = 40;
+  p->snr = 26;
+  p->amplitude = 6000;
+  p->deviation = 30000;
+  p->offset = 0;
+  p->bitrate = 1;
+  p->density = 2;
+  p->tx29 = 0.5;
+  p->seed = 1;
+}
+
+/* xorshift, so the output does not depend on the libc */
+static uint32_t sg_state;
+
+static uint32_t sg_rand( void ) {
+  sg_state ^= sg_state << 13;
+  sg_state ^= sg_state >> 17;
+  sg_state ^= sg_state << 5;
+  return sg_state;
+}
+
+/// uniform in [0, 1)
+static double sg_uniform( void ) {
+  return (sg_rand() >> 8) * (1.0 / (1 << 24));
+}
+
+/// integer in [lo, hi]
+static int sg_int( int lo, int hi ) {
+  return lo + (int)(sg_uniform() * (hi - lo + 1));
+}
+
+/// standard normal (Box-Muller)
+static double sg_gauss( void ) {
+  double u = sg_uniform();
+  double v = sg_uniform();
+  return sqrt( -2 * log( 1 - u ) ) * cos( 2 * M_PI * v );
+}
+
+static int sg_put( siggen_t *g, size_t *len, double v ) {
+  if (g->length >= *len) {
+    size_t l = *len ? 2 * *len : 1 << 16;
+    int16_t *s = realloc( g->samples, l * sizeof(s[0]) );
+    if (s == 0) return -1;
+    g->samples = s;
+    *len = l;
+  }
+  g->samples[g->length++] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)lrint( v );
+  return 0;
+}
+
+static int sg_noise( siggen_t *g, size_t *len, size_t n, double sigma ) {
+  while (n-- > 0) {
+    if (sg_put( g, len, sigma * sg_gauss() ) != 0) return -1;
+  }
+  return 0;
+}
+
+/** NRZ modulate bytes at spb samples per bit, MSB first */
+static int sg_frame( siggen_t *g, size_t *len, const siggen_params_t *p, const uint8_t bytes[], int n, double spb, double sigma ) {
+  // the stations end their frames with a few alternating bits
+  static const int tail[] = { 0, 1, 0, 1 };
+  int bits = 8 * n + 4;
+  size_t k, samples = bits * spb;
+  double dc = p->offset / p->deviation * p->amplitude;
+  for (k = 0; k < samples; k++) {
+    int b = k / spb;
+    if (b >= bits) b = bits - 1;
+    int level = b < 8 * n ? (bytes[b >> 3] >> (7 - (b & 7))) & 1 : tail[b - 8 * n];
+    if (sg_put( g, len, (level ? p->amplitude : -p->amplitude) + dc + sigma * sg_gauss() ) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+int siggen_generate( const siggen_params_t *p, siggen_t *g ) {
+  size_t len = 0;
+  unsigned int i;
+  double sigma = p->amplitude / pow( 10, p->snr / 20 );
+  double scale = p->rate / 75000.0 / p->bitrate;
+  memset( g, 0, sizeof(*g) );
+  g->frames = calloc( p->frames ? p->frames : 1, sizeof(g->frames[0]) );
+  if (g->frames == 0) return -1;
+  sg_state = p->seed ? p->seed : 1;
+  if (sg_noise( g, &len, (size_t)SIGGEN_LEAD * p->rate / 75000, sigma ) != 0)
+    goto fail;
+  for (i = 0; i < p->frames; i++) {
+    siggen_frame_t *f = &g->frames[i];
+    uint8_t b[9] = { 0xaa, 0xaa, 0x2d, 0xd4 };
+    double spb;
+    if (sg_uniform() >= p->tx29) {
+      int hc = sg_int( 1, 15 ), ch = sg_int( 1, 3 );
+      int t = sg_int( 0, 600 ) + 300;   // tenths of a degree above -50°C
+      int hum = sg_int( 20, 90 );
+      b[4] = 0x51;
+      b[5] = (ch << 4) | hc;
+      b[6] = t / 10;
+      b[7] = t % 10;
+      b[8] = hum;
+      uint8_t sum = b[4] + b[5] + b[6] + b[7] + b[8];
+      uint8_t frame[10];
+      memcpy( frame, b, 9 );
+      frame[9] = -sum;
+      *f = (siggen_frame_t){ SIGGEN_WS300, (hc << 8) | ch, t / 10.0 - 50, hum, 0, 0 };
+      spb = SIGGEN_WS300_SPB * scale;
+      if (sg_frame( g, &len, p, frame, 10, spb, sigma ) != 0)
+        goto fail;
+    } else {
+      int sid = sg_int( 0, 63 );
+      int t = sg_int( 0, 799 );             // tenths of a degree above -40°C
+      int newbatt = sg_int( 0, 1 ), weakbatt = sg_int( 0, 1 );
+      int hum = sg_int( 20, 90 );
+      b[4] = 0x90 | (sid >> 2);
+      b[5] = ((sid & 3) << 6) | (newbatt << 5) | (t / 100);
+      b[6] = (((t / 10) % 10) << 4) | (t % 10);
+      b[7] = (weakbatt << 7) | hum;
+      b[8] = crc8( 0x131, &b[4], 4 );
+      *f = (siggen_frame_t){ SIGGEN_TX29, sid, t / 10.0 - 40, hum, newbatt | (weakbatt << 1), 0 };
+      spb = SIGGEN_TX29_SPB * scale;
+      if (sg_frame( g, &len, p, b, 9, spb, sigma ) != 0)
+        goto fail;
+    }
+    f->end = g->length;
+    g->n_frames++;
+    double gap = p->rate / p->density * (0.5 + sg_uniform());
+    if (gap < SIGGEN_MIN_GAP) gap = SIGGEN_MIN_GAP;
+    if (sg_noise( g, &len, gap, sigma ) != 0)
+      goto fail;
+  }
+  return 0;
+fail:
+  logging_error( "Could not allocate the synthetic capture.\n" );
+  siggen_free( g );
+  return -1;
+}
+
+void siggen_free( siggen_t *g ) {
+  free( g->samples );
+  free( g->frames );
+  memset( g, 0, sizeof(*g) );
+}
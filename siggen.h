@@ -0,0 +1,70 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SIGGEN_H
+#define SIGGEN_H 1
+
+/** synthetic FM demodulated captures, as rtl_fm would deliver them,
+ * holding WS300 and TX29 frames with valid checksums. Used by the
+ * generator tool and the benchmark.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum { SIGGEN_WS300, SIGGEN_TX29 };
+
+typedef struct {
+  unsigned int rate;        ///< sample rate in S/s
+  unsigned int frames;      ///< number of frames
+  double snr;               ///< signal amplitude over noise rms in dB
+  double amplitude;         ///< signal amplitude at the deviation
+  double deviation;         ///< FSK deviation in Hz
+  double offset;            ///< carrier frequency offset in Hz
+  double bitrate;           ///< factor on the nominal bit rates
+  double density;           ///< frames per second on average
+  double tx29;              ///< fraction of TX29 frames
+  unsigned int seed;
+} siggen_params_t;
+
+/// what a frame holds, as a decoder should report it
+typedef struct {
+  int protocol;
+  int sensor_id;
+  float temp;
+  float rel_hum;
+  int flags;
+  size_t end;               ///< sample after the frame
+} siggen_frame_t;
+
+typedef struct {
+  int16_t *samples;
+  size_t length;
+  siggen_frame_t *frames;
+  unsigned int n_frames;
+} siggen_t;
+
+/// 75 kS/s, 40 frames, 26 dB, 2 frames/s, half of them TX29
+void siggen_defaults( siggen_params_t *p );
+/// synthesize a capture, returns 0 on success
+int siggen_generate( const siggen_params_t *p, siggen_t *g );
+void siggen_free( siggen_t *g );
+
+#endif
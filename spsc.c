@@ -0,0 +1,87 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include "spsc.h"
+#include "logging.h"
+
+int spsc_init( spsc_t *q, const char *name, unsigned int size, size_t slot_size ) {
+  if ((size == 0) || ((size & (size - 1)) != 0)) {
+    logging_error( "Queue %s: size %i is not a power of two.\n", name, size );
+    return -1;
+  }
+  q->name = name;
+  q->size = size;
+  q->slot_size = slot_size;
+  q->slots = malloc( size * slot_size );
+  if (q->slots == 0) {
+    logging_error( "Queue %s: could not allocate %i slots.\n", name, size );
+    return -1;
+  }
+  atomic_init( &q->head, 0 );
+  atomic_init( &q->tail, 0 );
+  atomic_init( &q->pushed, 0 );
+  atomic_init( &q->drops, 0 );
+  atomic_init( &q->max_depth, 0 );
+  return 0;
+}
+
+void spsc_free( spsc_t *q ) {
+  free( q->slots );
+  q->slots = 0;
+}
+
+void *spsc_push_slot( spsc_t *q ) {
+  unsigned int head = atomic_load_explicit( &q->head, memory_order_relaxed );
+  unsigned int tail = atomic_load_explicit( &q->tail, memory_order_acquire );
+  if (head - tail >= q->size)
+    return 0;
+  return q->slots + (head & (q->size - 1)) * q->slot_size;
+}
+
+void spsc_push( spsc_t *q ) {
+  unsigned int head = atomic_load_explicit( &q->head, memory_order_relaxed );
+  unsigned int depth = head + 1 - atomic_load_explicit( &q->tail, memory_order_relaxed );
+  atomic_store_explicit( &q->head, head + 1, memory_order_release );
+  atomic_fetch_add_explicit( &q->pushed, 1, memory_order_relaxed );
+  if (depth > atomic_load_explicit( &q->max_depth, memory_order_relaxed ))
+    atomic_store_explicit( &q->max_depth, depth, memory_order_relaxed );
+}
+
+void spsc_drop( spsc_t *q ) {
+  atomic_fetch_add_explicit( &q->drops, 1, memory_order_relaxed );
+}
+
+void *spsc_pop_slot( spsc_t *q ) {
+  unsigned int tail = atomic_load_explicit( &q->tail, memory_order_relaxed );
+  unsigned int head = atomic_load_explicit( &q->head, memory_order_acquire );
+  if (head == tail)
+    return 0;
+  return q->slots + (tail & (q->size - 1)) * q->slot_size;
+}
+
+void spsc_pop( spsc_t *q ) {
+  unsigned int tail = atomic_load_explicit( &q->tail, memory_order_relaxed );
+  atomic_store_explicit( &q->tail, tail + 1, memory_order_release );
+}
+
+unsigned int spsc_depth( spsc_t *q ) {
+  return atomic_load_explicit( &q->head, memory_order_acquire ) - atomic_load_explicit( &q->tail, memory_order_acquire );
+}
@@ -0,0 +1,67 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SPSC_H
+#define SPSC_H 1
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/// the producer and the consumer side of a queue are kept this far apart
+#define SPSC_CACHE_LINE 64
+
+/** bounded single-producer/single-consumer queue of fixed size slots.
+ * The producer fills a slot in place between spsc_push_slot() and
+ * spsc_push(), the consumer reads it between spsc_pop_slot() and
+ * spsc_pop(). No locks, one thread on each side.
+ */
+typedef struct {
+  const char *name;
+  unsigned int size;          ///< number of slots, power of two
+  size_t slot_size;
+  unsigned char *slots;
+  // producer side, with its statistics
+  _Alignas(SPSC_CACHE_LINE) atomic_uint head; ///< next slot to fill, written by producer
+  atomic_ulong pushed;
+  atomic_ulong drops;         ///< items the producer had to discard
+  atomic_uint max_depth;      ///< high water mark of queued items
+  // consumer side, on its own cache line
+  _Alignas(SPSC_CACHE_LINE) atomic_uint tail; ///< next slot to read, written by consumer
+} spsc_t;
+
+int spsc_init( spsc_t *q, const char *name, unsigned int size, size_t slot_size );
+void spsc_free( spsc_t *q );
+
+/// free slot to fill or 0 if the queue is full
+void *spsc_push_slot( spsc_t *q );
+/// publish the slot returned by spsc_push_slot()
+void spsc_push( spsc_t *q );
+/// account for an item that was discarded because the queue was full
+void spsc_drop( spsc_t *q );
+
+/// oldest filled slot or 0 if the queue is empty
+void *spsc_pop_slot( spsc_t *q );
+/// release the slot returned by spsc_pop_slot()
+void spsc_pop( spsc_t *q );
+
+/// number of queued items
+unsigned int spsc_depth( spsc_t *q );
+
+#endif
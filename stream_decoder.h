@@ -23,15 +23,29 @@
 #define STREAM_DECODER_H 1
 
 #include "data_logger.h"
+#include "metrics.h"
+#include <stdint.h>
 
-/* interface for stream decoder */
-typedef struct {
+/* interface for stream decoder, instances work like sample decoders */
+typedef struct stream_decoder stream_decoder_t;
+struct stream_decoder {
   char *name;
   char *shorthand;
+  void *ctx;  ///< state of this instance
   // interface
-  int (*init)(data_logger_t *next);
-  int (*input)(int transmission[], unsigned length);
-} stream_decoder_t;
+  int (*init)(stream_decoder_t *self, data_logger_t *next);
+  int (*input)(stream_decoder_t *self, int transmission[], unsigned length, const rx_info_t *rx);
+  // optional: sync word the decoder looks for (magic_length bits, MSB
+  // first). A dispatcher then searches it once for all decoders sharing
+  // it and hands over the aligned bytes, tm[0] being the first magic byte.
+  const int *magic;
+  int magic_length;
+  int (*input_aligned)(stream_decoder_t *self, const uint8_t tm[], unsigned length, const rx_info_t *rx);
+  // optional: frames with the magic that no decoder took. The dispatcher
+  // counts them once all decoders of the magic had a try.
+  metric_t *rejected;
+  void (*destroy)(stream_decoder_t *self);
+};
 
 
 
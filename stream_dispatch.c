@@ -0,0 +1,153 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "stream_dispatch.h"
+#include "tools.h"
+#include "logging.h"
+
+/// maximum number of registered decoders
+#define DISPATCH_DECODERS 16
+/// number of bytes handed to input_aligned(), starting at the magic
+#define DISPATCH_ALIGNED_LEN 32
+
+/* state of one dispatcher */
+typedef struct {
+  stream_decoder_t *decoders[DISPATCH_DECODERS];
+  /// index of the first decoder with the same magic, i.e. the group
+  int group[DISPATCH_DECODERS];
+  int n;
+} dispatch_ctx_t;
+
+static int dispatch_same_magic( stream_decoder_t *a, stream_decoder_t *b ) {
+  if ((a->magic_length != b->magic_length) || (a->magic == 0) || (b->magic == 0))
+    return 0;
+  int i;
+  for (i = 0; i < (a->magic_length + 7) >> 3; i++) {
+    if ((a->magic[i] & 0xFF) != (b->magic[i] & 0xFF))
+      return 0;
+  }
+  return 1;
+}
+
+int dispatch_add( stream_decoder_t *self, stream_decoder_t *sd ) {
+  dispatch_ctx_t *c = self->ctx;
+  if (sd == 0) return -1;
+  if (c->n >= DISPATCH_DECODERS) {
+    logging_error( "Too many stream decoders, not adding %s.\n", sd->shorthand );
+    return -1;
+  }
+  if ((sd->magic != 0) && ((sd->input_aligned == 0) || (sd->magic_length > MAGIC_MAX_BITS))) {
+    logging_error( "Stream decoder %s has an unusable magic.\n", sd->shorthand );
+    return -1;
+  }
+  int i;
+  c->group[c->n] = c->n;
+  for (i = 0; i < c->n; i++) {
+    if (dispatch_same_magic( c->decoders[i], sd )) {
+      c->group[c->n] = c->group[i];
+      break;
+    }
+  }
+  c->decoders[c->n++] = sd;
+  return 0;
+}
+
+int dispatch_init( stream_decoder_t *self, data_logger_t *next ) {
+  dispatch_ctx_t *c = self->ctx;
+  if (next == 0) return -1;
+  int i;
+  for (i = 0; i < c->n; i++) {
+    if ((c->decoders[i]->init != 0) && (c->decoders[i]->init( c->decoders[i], next ) != 0))
+      return -1;
+  }
+  logging_info( "Dispatcher initialized with %i stream decoders.\n", c->n );
+  return 0;
+}
+
+int dispatch_input( stream_decoder_t *self, int transmission[], unsigned length, const rx_info_t *rx ) {
+  dispatch_ctx_t *c = self->ctx;
+  // aligned bytes per group, filled on first use. -1: not searched yet,
+  // 0: magic not found, otherwise number of bytes
+  uint8_t tm[DISPATCH_DECODERS][DISPATCH_ALIGNED_LEN];
+  int tm_len[DISPATCH_DECODERS];
+  int tried[DISPATCH_DECODERS];
+  int i, n_tried = 0;
+  for (i = 0; i < c->n; i++)
+    tm_len[i] = -1;
+  for (i = 0; i < c->n; i++) {
+    stream_decoder_t *sd = c->decoders[i];
+    int ret;
+    if (sd->magic == 0) {
+      ret = sd->input( sd, transmission, length, rx );
+    } else {
+      int g = c->group[i];
+      if (tm_len[g] < 0) {
+        magic_match_t m;
+        if (magic_find( transmission, length, sd->magic, sd->magic_length, &m ) == 0)
+          tm_len[g] = magic_extract( transmission, length, &m, tm[g], DISPATCH_ALIGNED_LEN );
+        else
+          tm_len[g] = 0;
+      }
+      if (tm_len[g] == 0)
+        continue;
+      ret = sd->input_aligned( sd, tm[g], tm_len[g], rx );
+    }
+    if (ret == 0)
+      return 0;
+    tried[n_tried++] = i;
+  }
+  // a frame is rejected by a protocol only if no other one took it
+  for (i = 0; i < n_tried; i++)
+    metrics_add( c->decoders[tried[i]]->rejected, 1 );
+  return -1;
+}
+
+void dispatch_destroy( stream_decoder_t *self ) {
+  dispatch_ctx_t *c = self->ctx;
+  int i;
+  for (i = 0; i < c->n; i++) {
+    if (c->decoders[i]->destroy != 0)
+      c->decoders[i]->destroy( c->decoders[i] );
+  }
+  free( c );
+  free( self );
+}
+
+stream_decoder_t *dispatch_create( void ) {
+  stream_decoder_t *self = malloc( sizeof(*self) );
+  dispatch_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a dispatcher.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (stream_decoder_t){
+    .name = "Dispatcher to all registered stream decoders",
+    .shorthand = "dispatch",
+    .ctx = c,
+    .init = dispatch_init,
+    .input = dispatch_input,
+    .destroy = dispatch_destroy
+  };
+  return self;
+}
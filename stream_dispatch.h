@@ -0,0 +1,40 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef STREAM_DISPATCH_H
+#define STREAM_DISPATCH_H 1
+
+#include "stream_decoder.h"
+
+/** stream decoder fanning a transmission out to the registered stream
+ * decoders. Decoders announcing the same magic are grouped, the magic is
+ * searched once per group and the aligned bytes are handed to each of
+ * them. Decoders are tried in the order they were added and dispatching
+ * stops at the first one accepting the transmission (returning 0).
+ * init() initializes all registered decoders with the given logger,
+ * destroy() destroys them as well.
+ */
+stream_decoder_t *dispatch_create( void );
+
+/** register sd with the dispatcher self, which then owns it.
+ * return 0 on success */
+int dispatch_add( stream_decoder_t *self, stream_decoder_t *sd );
+
+#endif
@@ -0,0 +1,156 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+/** vectorized idle detection for the transmission decoder.
+ * One of the variants below is selected at compile time, the scalar one
+ * is used if the compiler does not announce any of the instruction sets
+ * or if TD_KERNEL_SCALAR is defined.
+ * All of them give the same answer, the vector variants only see int16
+ * limits, so a limit beyond the int16 range is clamped which may report
+ * a chunk as not quiet that is. The caller falls back to the per-sample
+ * path in that case.
+ */
+
+#include <stdint.h>
+#include "td_kernel.h"
+
+#if defined(TD_KERNEL_SCALAR)
+#elif defined(__AVX2__)
+#define TD_KERNEL_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define TD_KERNEL_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define TD_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+static inline int16_t td_kernel_limit( int limit ) {
+  return limit > INT16_MAX ? INT16_MAX : limit;
+}
+
+static int td_kernel_quiet_scalar( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum ) {
+  int32_t sum = 0;
+  unsigned int i;
+  for (i = 0; i < length; i++) {
+    int s = samples[i];
+    if ((s > limit) || (s < -limit))
+      return 0;
+    sum += s < 0 ? -s : s;
+  }
+  *abs_sum = sum;
+  return 1;
+}
+
+#if defined(TD_KERNEL_AVX2)
+
+const char *td_kernel_name = "avx2";
+
+int td_kernel_quiet( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum ) {
+  int16_t l = td_kernel_limit( limit );
+  __m256i hi = _mm256_set1_epi16( l );
+  __m256i lo = _mm256_set1_epi16( -l );
+  __m256i ones = _mm256_set1_epi16( 1 );
+  __m256i sum = _mm256_setzero_si256();
+  unsigned int i;
+  for (i = 0; i + 16 <= length; i += 16) {
+    __m256i s = _mm256_loadu_si256( (const __m256i *)&samples[i] );
+    __m256i out = _mm256_or_si256( _mm256_cmpgt_epi16( s, hi ), _mm256_cmpgt_epi16( lo, s ) );
+    if (!_mm256_testz_si256( out, out ))
+      return 0;
+    // no sample is -32768 here, so the 16 bit abs is exact
+    sum = _mm256_add_epi32( sum, _mm256_madd_epi16( _mm256_abs_epi16( s ), ones ) );
+  }
+  __m128i sum4 = _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) );
+  sum4 = _mm_add_epi32( sum4, _mm_shuffle_epi32( sum4, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+  sum4 = _mm_add_epi32( sum4, _mm_shuffle_epi32( sum4, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+  int32_t tail;
+  if (!td_kernel_quiet_scalar( &samples[i], length - i, limit, &tail ))
+    return 0;
+  *abs_sum = _mm_cvtsi128_si32( sum4 ) + tail;
+  return 1;
+}
+
+#elif defined(TD_KERNEL_SSE2)
+
+const char *td_kernel_name = "sse2";
+
+int td_kernel_quiet( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum ) {
+  int16_t l = td_kernel_limit( limit );
+  __m128i hi = _mm_set1_epi16( l );
+  __m128i lo = _mm_set1_epi16( -l );
+  __m128i zero = _mm_setzero_si128();
+  __m128i ones = _mm_set1_epi16( 1 );
+  __m128i sum = zero;
+  unsigned int i;
+  for (i = 0; i + 8 <= length; i += 8) {
+    __m128i s = _mm_loadu_si128( (const __m128i *)&samples[i] );
+    __m128i out = _mm_or_si128( _mm_cmpgt_epi16( s, hi ), _mm_cmplt_epi16( s, lo ) );
+    if (_mm_movemask_epi8( out ) != 0)
+      return 0;
+    // no sample is -32768 here, so the 16 bit abs is exact
+    __m128i a = _mm_max_epi16( s, _mm_sub_epi16( zero, s ) );
+    sum = _mm_add_epi32( sum, _mm_madd_epi16( a, ones ) );
+  }
+  sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+  sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+  int32_t tail;
+  if (!td_kernel_quiet_scalar( &samples[i], length - i, limit, &tail ))
+    return 0;
+  *abs_sum = _mm_cvtsi128_si32( sum ) + tail;
+  return 1;
+}
+
+#elif defined(TD_KERNEL_NEON)
+
+const char *td_kernel_name = "neon";
+
+int td_kernel_quiet( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum ) {
+  int16_t l = td_kernel_limit( limit );
+  int16x8_t hi = vdupq_n_s16( l );
+  int16x8_t lo = vdupq_n_s16( -l );
+  int32x4_t sum = vdupq_n_s32( 0 );
+  unsigned int i;
+  for (i = 0; i + 8 <= length; i += 8) {
+    int16x8_t s = vld1q_s16( &samples[i] );
+    uint16x8_t out = vorrq_u16( vcgtq_s16( s, hi ), vcltq_s16( s, lo ) );
+    uint32x2_t out2 = vreinterpret_u32_u16( vorr_u16( vget_low_u16( out ), vget_high_u16( out ) ) );
+    if ((vget_lane_u32( out2, 0 ) | vget_lane_u32( out2, 1 )) != 0)
+      return 0;
+    // no sample is -32768 here, so the 16 bit abs is exact
+    sum = vpadalq_s16( sum, vabsq_s16( s ) );
+  }
+  int32x2_t sum2 = vadd_s32( vget_low_s32( sum ), vget_high_s32( sum ) );
+  int32_t tail;
+  if (!td_kernel_quiet_scalar( &samples[i], length - i, limit, &tail ))
+    return 0;
+  *abs_sum = vget_lane_s32( sum2, 0 ) + vget_lane_s32( sum2, 1 ) + tail;
+  return 1;
+}
+
+#else
+
+const char *td_kernel_name = "scalar";
+
+int td_kernel_quiet( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum ) {
+  return td_kernel_quiet_scalar( samples, length, limit, abs_sum );
+}
+
+#endif
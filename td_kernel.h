@@ -0,0 +1,37 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TD_KERNEL_H
+#define TD_KERNEL_H 1
+
+#include <stdint.h>
+
+/** check samples[0..length-1] for the "nothing here" case.
+ * returns 1 if every sample lies within [-limit, limit] and stores the
+ * sum of the absolute sample values in *abs_sum. returns 0 as soon as
+ * one sample exceeds the limit, *abs_sum is undefined then.
+ * The caller keeps length small enough for the sum to fit.
+ */
+int td_kernel_quiet( const int16_t samples[], unsigned int length, int limit, int32_t *abs_sum );
+
+/// name of the compiled in kernel variant
+extern const char *td_kernel_name;
+
+#endif
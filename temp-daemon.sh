@@ -22,33 +22,29 @@
 
 # temperature daemon.
 #
-# Send SIGUSR1 to this process to force a restart of the
-# receiver and decoder and to select the next output filename
+# Send SIGUSR1 to this process to select the next output filename. The
+# receiver keeps running, rtl_868 reopens its output file.
 #
-# output file is named w.r.t. current time.
+# output file is named w.r.t. current time, a new one is started every day.
 #
 
 
 # trap the SIGUSR1:
 function hnd_SIGUSR1() {
-  echo "Killing receiver on user request."
-  kill $RX_PID
-  wait $RX_PID
+  echo "Rotating output file on user request."
+  kill -USR1 $RX_PID
 }
 trap hnd_SIGUSR1 SIGUSR1
 
 cd `dirname $0`
 
 while true; do
-  # determine output filename
-  FN="temp-`date +%Y%m%d-%H%M.csv`"
-  echo "Using output filename \"${FN}\"."
+  echo "Using output filenames \"temp-%Y%m%d-%H%M.csv\"."
   # start the daemon in background
-  rtl_fm -f 868.26e6 -M fm -s 500k -r 75k -g 42 -A fast | ./rtl_868 -vvv >>${FN} &
+  rtl_fm -f 868.26e6 -M fm -s 500k -r 75k -g 42 -A fast | ./rtl_868 -vvv -L -o "temp-%Y%m%d-%H%M.csv" -R 86400 &
   RX_PID=$!
-  # wait for signal or termination
-  wait ${RX_PID}
-  ERET=$?
+  # wait for termination, the trap interrupts the wait
+  while wait ${RX_PID}; ERET=$?; kill -0 ${RX_PID} 2>/dev/null; do :; done
   if (( $ERET <= 128 )); then
     echo ""
     echo "Process exited with $ERET.";
@@ -56,4 +52,3 @@ while true; do
   fi
   echo "Done. Will restart receiver on next loop."
 done;
-
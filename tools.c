@@ -29,9 +29,12 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tools.h"
 #include "logging.h"
 
-uint8_t crc8(uint16_t poly, uint8_t *vptr, int len)
+static uint8_t crc8_bitwise(uint16_t poly, const uint8_t *vptr, int len)
 {
   const uint8_t *data = vptr;
   uint16_t crc = 0;
@@ -47,61 +50,131 @@ uint8_t crc8(uint16_t poly, uint8_t *vptr, int len)
   return (uint8_t)(crc >> 8);
 }
 
-int search_magic(int transmission[], unsigned length, uint8_t tm[], int tm_length, int magic[], int magic_length) {
-  /* search for magic_lenght bits (given by magic[]) within transmission[] and return the
-   * properly shifted version of transmission[] in tm[], so that
-   * tm[0] is magic[0], etc.
-   * tm_length must be larger than magic_length!
-   * return number of bytes within tm.
-   */
-  unsigned int shift;
-  unsigned int ofs;
-  unsigned int shf;
-  int inv = 0;
-  unsigned int i = 0;
-  for (shift = 0; shift < length*8; shift++) {
-    ofs = shift >> 3;
-    shf = shift & 7;
-    // check if we would already exceed packet size with preamble and length field
-    if (magic_length + (shift + 7) >> 3 > length) {
-      logging_warning( "Transmission too short: %i.\n", length );
-      return 0;
-    }
-    for (i = 0; i <= (magic_length | 0x07) >> 3; i++) {
-      tm[i] = ((transmission[i+ofs+1] | (transmission[i+ofs]<<8)) >> (8-shf)) & 0xFF;
+/* Lookup tables for crc8, one set per polynomial. t[0][b] is the crc of
+ * the byte b, t[k][b] the crc of b followed by k zero bytes, which allows
+ * to process 4 or 8 bytes per step (slice-by-N). Tables are built on
+ * first use and never freed. The bitwise code above is the reference and
+ * still used for polynomials that are not 9 bits wide, where the upper
+ * byte of the 16 bit register does not reduce to a plain crc8.
+ */
+#define CRC8_TABLES 4
+#define CRC8_SLICES 8
+typedef struct {
+  atomic_uint poly;  ///< 0 while unused, written after t[][] is complete
+  uint8_t t[CRC8_SLICES][256];
+} crc8_table_t;
+static crc8_table_t crc8_tables[CRC8_TABLES];
+static pthread_mutex_t crc8_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const crc8_table_t *crc8_table( uint16_t poly ) {
+  int i, k;
+  if ((poly & 0xFF00) != 0x0100) return 0;
+  for (i = 0; i < CRC8_TABLES; i++) {
+    if (atomic_load_explicit( &crc8_tables[i].poly, memory_order_acquire ) == poly)
+      return &crc8_tables[i];
+  }
+  // not there yet, build it
+  const crc8_table_t *found = 0;
+  pthread_mutex_lock( &crc8_lock );
+  for (i = 0; i < CRC8_TABLES; i++) {
+    unsigned int p = atomic_load_explicit( &crc8_tables[i].poly, memory_order_relaxed );
+    if (p == poly) {
+      found = &crc8_tables[i];
+      break;
     }
-    // now check tm
-    int found = 0;
-    int msk;
-    for (i = 0; i < (magic_length | 0x07) >> 3; i++) {
-      if (i << 3 > magic_length) {
-        msk = (1<<(magic_length & 0x07)) - 1;
-      } else {
-        msk = 0xFF;
-      }
-      if ((tm[i] & msk) != (magic[i] & msk))
-        found |= 1;
-      if (((tm[i] & msk) ^ 0xFF) != (magic[i] & msk))
-        found |= 2;
-      if (found == 0x03) {
-        break;
+    if (p == 0) {
+      crc8_table_t *ct = &crc8_tables[i];
+      unsigned int b;
+      for (b = 0; b < 256; b++) {
+        uint8_t byte = b;
+        ct->t[0][b] = crc8_bitwise( poly, &byte, 1 );
       }
-    }
-    // bit in found is set if at least one of the
-    // magic bytes did not match
-    if (found == 0x01) {
-      inv = 0xFF;
+      for (k = 1; k < CRC8_SLICES; k++)
+        for (b = 0; b < 256; b++)
+          ct->t[k][b] = ct->t[0][ct->t[k-1][b]];
+      atomic_store_explicit( &ct->poly, poly, memory_order_release );
+      found = ct;
       break;
     }
-    if (found == 0x02) {
-      inv = 0x00;
-      break;
+  }
+  pthread_mutex_unlock( &crc8_lock );
+  if (found == 0)
+    logging_warning( "No crc8 table left for polynomial %03x, using bitwise crc.\n", poly );
+  return found;
+}
+
+int crc8_init( uint16_t poly ) {
+  return crc8_table( poly ) == 0 ? -1 : 0;
+}
+
+uint8_t crc8(uint16_t poly, uint8_t *vptr, int len)
+{
+  const crc8_table_t *ct = crc8_table( poly );
+  if (ct == 0)
+    return crc8_bitwise( poly, vptr, len );
+  const uint8_t *d = vptr;
+  uint8_t crc = 0;
+  for (; len >= 8; len -= 8, d += 8) {
+    crc = ct->t[7][crc ^ d[0]] ^ ct->t[6][d[1]] ^ ct->t[5][d[2]] ^ ct->t[4][d[3]] ^
+          ct->t[3][d[4]] ^ ct->t[2][d[5]] ^ ct->t[1][d[6]] ^ ct->t[0][d[7]];
+  }
+  if (len >= 4) {
+    crc = ct->t[3][crc ^ d[0]] ^ ct->t[2][d[1]] ^ ct->t[1][d[2]] ^ ct->t[0][d[3]];
+    len -= 4;
+    d += 4;
+  }
+  for (; len > 0; len--, d++)
+    crc = ct->t[0][crc ^ *d];
+  return crc;
+}
+
+int magic_find(const int transmission[], unsigned length, const int magic[], int magic_length, magic_match_t *m) {
+  /* slide a shift register over the packed bits of transmission[] and
+   * compare the last magic_length bits against magic[] and its inverse
+   * at every bit position. Each byte is shifted in at once and the 8 bit
+   * positions ending within it are checked against the register, so
+   * nothing is recomputed per shift.
+   */
+  if ((magic_length <= 0) || (magic_length > MAGIC_MAX_BITS))
+    return -1;
+  int nbytes = (magic_length + 7) >> 3;
+  uint64_t pattern = 0;
+  int i;
+  for (i = 0; i < nbytes; i++)
+    pattern = (pattern << 8) | (magic[i] & 0xFF);
+  pattern >>= 8 * nbytes - magic_length;
+  uint64_t mask = (((uint64_t)1) << magic_length) - 1;
+  uint64_t inverse = ~pattern & mask;
+  uint64_t reg = 0;
+  unsigned int ofs;
+  for (ofs = 0; ofs < length; ofs++) {
+    reg = (reg << 8) | (transmission[ofs] & 0xFF);
+    // bits available after this byte, a window needs magic_length of them
+    unsigned int bits = 8 * (ofs + 1);
+    int shf;
+    for (shf = 0; shf < 8; shf++) {
+      // window ending at bit shf of this byte
+      if (bits - (7 - shf) < (unsigned int)magic_length)
+        continue;
+      uint64_t w = (reg >> (7 - shf)) & mask;
+      if ((w == pattern) || (w == inverse)) {
+        m->bit = bits - (7 - shf) - magic_length;
+        m->inv = (w == pattern) ? 0x00 : 0xFF;
+        return 0;
+      }
     }
   }
-  if (shift >= length*8) {
+  if (length * 8 < (unsigned int)magic_length)
+    logging_warning( "Transmission too short: %i.\n", length );
+  else
     logging_warning( "No preamble detected. Ignoring dataset.\n" );
-    return 0;
-  }
+  return -1;
+}
+
+int magic_extract(const int transmission[], unsigned length, const magic_match_t *m, uint8_t tm[], int tm_length) {
+  unsigned int ofs = m->bit >> 3;
+  unsigned int shf = m->bit & 7;
+  unsigned int i;
   // fill the shifted data into tm and empty bits with 0
   for (i = 0; (i<tm_length/sizeof(tm[0])); i++) {
     if (i+ofs+1 < length) {
@@ -111,7 +184,7 @@ int search_magic(int transmission[], unsigned length, uint8_t tm[], int tm_lengt
     } else {
       tm[i] = 0;
     }
-    tm[i] ^= inv;
+    tm[i] ^= m->inv;
   }
   ofs = length - ofs; // number of filled bytes in tm
   if (ofs >= tm_length/sizeof(tm[0])) {
@@ -119,3 +192,16 @@ int search_magic(int transmission[], unsigned length, uint8_t tm[], int tm_lengt
   }
   return ofs;
 }
+
+int search_magic(int transmission[], unsigned length, uint8_t tm[], int tm_length, int magic[], int magic_length) {
+  /* search for magic_lenght bits (given by magic[]) within transmission[] and return the
+   * properly shifted version of transmission[] in tm[], so that
+   * tm[0] is magic[0], etc.
+   * tm_length must be larger than magic_length!
+   * return number of bytes within tm.
+   */
+  magic_match_t m;
+  if (magic_find( transmission, length, magic, magic_length, &m ) != 0)
+    return 0;
+  return magic_extract( transmission, length, &m, tm, tm_length );
+}
@@ -24,8 +24,32 @@
 
 #include <stdint.h>
 
-/** calculate crc8 */
+/** calculate crc8, table driven for 9 bit polynomials (e.g. 0x131) */
 uint8_t crc8( uint16_t poly, uint8_t *data, int len );
+/** build the crc8 table for poly now instead of on first use */
+int crc8_init( uint16_t poly );
+
+/// longest magic (in bits) magic_find() can look for
+#define MAGIC_MAX_BITS 56
+
+/** where a magic was found in a transmission. The same match can be
+ * extracted by every decoder looking for the same magic.
+ */
+typedef struct {
+  unsigned int bit;  ///< bit offset of the first magic bit
+  uint8_t inv;       ///< 0xFF if the transmission carries the inverted magic
+} magic_match_t;
+
+/** find the first occurrence of the magic_length bits in magic[] (MSB
+ * first) or of their inverse within transmission[]. return 0 if found.
+ */
+int magic_find(const int transmission[], unsigned length, const int magic[], int magic_length, magic_match_t *m);
+/** copy the bytes starting at match m into tm[], inverting them if
+ * needed and zero (before inversion) past the end of transmission[].
+ * return number of bytes within tm.
+ */
+int magic_extract(const int transmission[], unsigned length, const magic_match_t *m, uint8_t tm[], int tm_length);
+/// magic_find() followed by magic_extract()
 int search_magic(int transmission[], unsigned length, uint8_t tm[], int tm_length, int magic[], int magic_length);
 
 
@@ -0,0 +1,89 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "trace.h"
+#include "metrics.h"
+#include "logging.h"
+#include <stdio.h>
+#include <pthread.h>
+
+int trace_enabled = 0;
+FILE *trace_file;
+/// records may be written from several threads
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// stages, between the stamps of rx_info_t and the time it is written
+enum { TRACE_DETECT, TRACE_BITS, TRACE_DECODE, TRACE_LOG, TRACE_TOTAL, TRACE_STAGES };
+static const char *trace_names[TRACE_STAGES] = { "detect", "bits", "decode", "log", "total" };
+metric_t *trace_stages[TRACE_STAGES];
+/// buckets of the stage histograms, in seconds
+static const double trace_bounds[] = { 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 0.1, 1, 10 };
+
+void trace_enable( void ) {
+  if (trace_enabled) return;
+  trace_enabled = 1;
+  trace_stages[TRACE_DETECT] = metrics_histogram( "rtl868_stage_seconds{stage=\"detect\"}",
+    "Time between the stamps of a transmission: detect is from its start to the end of the transmission, bits is slicing incl. queueing, decode the protocol decoder, log writing the record.",
+    trace_bounds, sizeof(trace_bounds)/sizeof(trace_bounds[0]) );
+  trace_stages[TRACE_BITS] = metrics_histogram( "rtl868_stage_seconds{stage=\"bits\"}", "", trace_bounds, sizeof(trace_bounds)/sizeof(trace_bounds[0]) );
+  trace_stages[TRACE_DECODE] = metrics_histogram( "rtl868_stage_seconds{stage=\"decode\"}", "", trace_bounds, sizeof(trace_bounds)/sizeof(trace_bounds[0]) );
+  trace_stages[TRACE_LOG] = metrics_histogram( "rtl868_stage_seconds{stage=\"log\"}", "", trace_bounds, sizeof(trace_bounds)/sizeof(trace_bounds[0]) );
+  trace_stages[TRACE_TOTAL] = metrics_histogram( "rtl868_stage_seconds{stage=\"total\"}", "", trace_bounds, sizeof(trace_bounds)/sizeof(trace_bounds[0]) );
+}
+
+int trace_open( const char *filename ) {
+  trace_file = fopen( filename, "w" );
+  if (trace_file == 0) {
+    logging_error( "Could not open trace file '%s'.\n", filename );
+    return -1;
+  }
+  // the JSON array format, viewers accept it without the closing bracket
+  fprintf( trace_file, "[\n" );
+  trace_enable();
+  return 0;
+}
+
+void trace_done( const rx_info_t *rx ) {
+  if (!trace_enabled || (rx->t_detect == 0))
+    return;
+  long long t[TRACE_STAGES + 1] = { rx->t_detect, rx->t_cut, rx->t_sliced, rx->t_decoded, trace_now() };
+  int i;
+  for (i = 0; i < TRACE_TOTAL; i++)
+    metrics_observe( trace_stages[i], (t[i + 1] - t[i]) * 1e-9 );
+  metrics_observe( trace_stages[TRACE_TOTAL], (t[TRACE_TOTAL] - t[0]) * 1e-9 );
+  if (trace_file == 0)
+    return;
+  pthread_mutex_lock( &trace_lock );
+  for (i = 0; i < TRACE_TOTAL; i++)
+    fprintf( trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"sample\":%llu}},\n",
+      trace_names[i], i + 1, t[i] * 1e-3, (t[i + 1] - t[i]) * 1e-3, rx->sample );
+  pthread_mutex_unlock( &trace_lock );
+}
+
+void trace_close( void ) {
+  if (trace_file == 0)
+    return;
+  pthread_mutex_lock( &trace_lock );
+  // an instant event, so that the last one has no trailing comma
+  fprintf( trace_file, "{\"name\":\"end\",\"ph\":\"i\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"s\":\"g\"}\n]\n", trace_now() * 1e-3 );
+  fclose( trace_file );
+  trace_file = 0;
+  pthread_mutex_unlock( &trace_lock );
+}
@@ -0,0 +1,53 @@
+/*
+    rtl_868
+    Copyright (C) 2015  Clemens Helfmeier
+    e-mail: clemenshelfmeier@gmx.de
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H 1
+
+/** latency tracing. Every stage stamps the rx_info_t of a transmission
+ * with trace_now(), the data logger closes it with trace_done(), which
+ * puts the time spent in each stage into histograms (see metrics.h) and,
+ * if a trace file is open, writes the stages as events of the Chrome
+ * trace format, to be viewed in chrome://tracing or Perfetto.
+ */
+
+#include <time.h>
+#include "rx_info.h"
+
+extern int trace_enabled;
+
+/// CLOCK_MONOTONIC in ns, 0 if tracing is disabled
+static inline long long trace_now( void ) {
+  struct timespec ts;
+  if (!trace_enabled) return 0;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/// stamp and register the stage histograms
+void trace_enable( void );
+/// enable and write the events to filename as well, returns 0 on success
+int trace_open( const char *filename );
+/// the record of rx has been written
+void trace_done( const rx_info_t *rx );
+/// finish the trace file
+void trace_close( void );
+
+#endif
@@ -21,116 +21,345 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 #include "sample_decoder.h"
 #include "transmission.h"
+#include "td_kernel.h"
 #include "logging.h"
-
-/// maximum number of samples within one transmission,
-/// everything exceeding this will be silently dropped
-#define TD_SAMPLES_LEN  1024
-
+#include "metrics.h"
+#include "trace.h"
+#include "pool.h"
+#include "sample_rate.h"
 
 typedef int16_t td_sample_t;
 typedef int32_t td_sample2x_t;
 
-/* where to handle received samples to */
-bit_decoder_t *td_next;
-int td_samples[TD_SAMPLES_LEN];
-unsigned int td_samples_i;
 
-/// threshold: this many samples required into either
-/// direction to detect a transmission
-#define TRANSMISSION_THRESHOLD 10
+/* state of one transmission decoder */
+typedef struct {
+  /* where to handle received samples to */
+  bit_decoder_t *next;
+  /** sample ring. Every sample is stored twice, at its position and at
+   * position + ring_len, so that any window of up to ring_len
+   * samples is contiguous in memory and can be handed to the bit decoder
+   * without copying. It comes from the POOL_RING pool, transmissions
+   * longer than it lose their oldest samples.
+   */
+  td_sample_t *ring;
+  unsigned int ring_len;
+  /// the current transmission lost samples
+  int truncated;
+  /// number of samples written so far (modulo 2^32)
+  unsigned int head;
+  /// first sample of the current window (reservoir or transmission)
+  unsigned int start;
+  /// first sample not yet handed to a streaming bit decoder
+  unsigned int pushed;
+  td_sample2x_t mean;
+  /// TRANSMISSION_THRESHOLD_US and SAMPLE_RESERVOIR_US in samples
+  int threshold;
+  unsigned int reservoir;
+  int transtime;
+  td_sample2x_t sigpwr;
+  int fade;
+  /// samples before the current input call and head at its start, to
+  /// number the samples beyond the 32 bits of head
+  unsigned long long base;
+  unsigned int base_head;
+  /// the transmission being recorded
+  rx_info_t rx;
+  // metrics
+  metric_t *m_samples, *m_noise, *m_accepted, *m_short, *m_weak;
+} td_ctx_t;
+
+/// threshold: samples of this many microseconds required into either
+/// direction to detect a transmission (10 samples at 75 kS/s)
+#define TRANSMISSION_THRESHOLD_US 133
 /// this much must the amplitude exceed the mean amplitude
 /// for digital value detection
 #define SAMPLE_AMPLITUDE_FACTOR 2
-/// this many samples are kept before the transmission starts
-/// according to the TRANSMISSION_THRESHOLD and after
-/// it has ended
-#define SAMPLE_RESERVOIR 32
+/// samples of this many microseconds are kept before the transmission
+/// starts according to the threshold and after it has ended (32 samples
+/// at 75 kS/s)
+#define SAMPLE_RESERVOIR_US 427
+/// idle runs shorter than this are not worth a td_kernel_quiet call
+#define TD_KERNEL_MIN 4
+/// samples looked at one by one once td_kernel_quiet saw one above the
+/// limit, before it is tried again
+#define TD_SCALAR_RUN 16
 
-td_sample2x_t td_mean = 500<<(sizeof(td_sample_t)*8);
-int td_transtime;
-td_sample2x_t td_sigpwr;
-int td_fade;
+#ifdef NRZ_FIXED
+/// mean signal of the transmission is above the noise floor, in integer math
+#define TD_STRONG( c, length ) ((int64_t)(c)->sigpwr > (int64_t)((c)->mean >> (sizeof(td_sample_t)*8)) * (length))
+#define TD_SIGNAL( c, length ) ((c)->sigpwr / (length))
+#define TD_SIGNAL_FMT "%i"
+#else
+#define TD_STRONG( c, length ) ((float)(c)->sigpwr/(float)(length) > (c)->mean >> (sizeof(td_sample_t)*8))
+#define TD_SIGNAL( c, length ) ((float)(c)->sigpwr/(float)(length))
+#define TD_SIGNAL_FMT "%1.0f"
+#endif
 
-int td_init( bit_decoder_t *next ) {
+int td_init( sample_decoder_t *self, bit_decoder_t *next ) {
+  td_ctx_t *c = self->ctx;
   if (next == 0) return -1;
-  td_next = next;
-  td_samples_i = 0;
-  td_fade = 0;
-  logging_info( "Transmission decoder initialized.\n" );
+  c->next = next;
+  pool_t *pool = pool_class( POOL_RING );
+  if (c->ring == 0)
+    c->ring = pool == 0 ? 0 : pool_get( pool );
+  if (c->ring == 0) {
+    logging_error( "Could not get a sample ring for the transmission decoder.\n" );
+    return -1;
+  }
+  c->ring_len = pool_size( pool ) / (2 * sizeof(c->ring[0]));
+  c->head = 0;
+  c->start = 0;
+  c->fade = 0;
+  logging_info( "Transmission decoder initialized, %s idle kernel.\n", td_kernel_name );
+  return 0;
+}
+
+/** hand the samples recorded since the last call to a streaming bit decoder */
+static void td_flush( td_ctx_t *c ) {
+  if ((int)(c->pushed - c->start) < 0) c->pushed = c->start;
+  if (c->pushed != c->head)
+    c->next->samples( c->next, &c->ring[c->pushed & (c->ring_len - 1)], c->head - c->pushed );
+  c->pushed = c->head;
+}
+
+/** append one sample to the current window */
+static inline void td_ring_put( td_ctx_t *c, td_sample_t sample ) {
+  if (c->head - c->start >= c->ring_len) {
+    if (!c->truncated)
+      logging_warning( "Transmission exceeds %i samples, dropping its oldest samples.\n", c->ring_len );
+    c->truncated = 1;
+    c->start++;
+  }
+  unsigned int p = c->head & (c->ring_len - 1);
+  c->ring[p] = c->ring[p + c->ring_len] = sample;
+  c->head++;
 }
 
-int td_input( td_sample_t sample ) {
+static inline void td_step( td_ctx_t *c, td_sample_t sample ) {
   // memorize the amplitude
-  td_sample_t sample_amplitude = td_mean >> (sizeof(td_sample_t)*8);
-  td_mean += abs(sample) - (sample_amplitude);
+  td_sample_t sample_amplitude = c->mean >> (sizeof(td_sample_t)*8);
+  c->mean += abs(sample) - (sample_amplitude);
   // check for transmission
-  int new_transtime = td_transtime;
+  int new_transtime = c->transtime;
   if ((sample > SAMPLE_AMPLITUDE_FACTOR * sample_amplitude) || (sample < - SAMPLE_AMPLITUDE_FACTOR * sample_amplitude)) {
     new_transtime++;
   } else {
     new_transtime--;
   }
-  if (new_transtime > 2*TRANSMISSION_THRESHOLD) {
-    new_transtime = 2*TRANSMISSION_THRESHOLD;
+  if (new_transtime > 2*c->threshold) {
+    new_transtime = 2*c->threshold;
   } else if (new_transtime < 0) {
     new_transtime = 0;
   }
   // memorize the new sample
-  td_samples[td_samples_i++] = sample;
-  if (td_samples_i >= TD_SAMPLES_LEN) td_samples_i = TD_SAMPLES_LEN - 1;
+  td_ring_put( c, sample );
+  unsigned int length = c->head - c->start;
   // see if we have no transmission
-  if ((new_transtime < TRANSMISSION_THRESHOLD) && (td_fade == 0)) {
+  if ((new_transtime < c->threshold) && (c->fade == 0)) {
     // signal is weak and no transmission is running
-    if (td_samples_i >= SAMPLE_RESERVOIR) {
-      // only keep SAMPLE_RESERVOIR samples
-      memmove( &td_samples[0], &td_samples[td_samples_i - SAMPLE_RESERVOIR + 1], (SAMPLE_RESERVOIR - 1) * sizeof(td_samples[0]) );
-      td_samples_i = SAMPLE_RESERVOIR - 1;
+    if (length >= c->reservoir) {
+      // only keep reservoir - 1 samples
+      c->start = c->head - (c->reservoir - 1);
     }
   } else {
     // either signal is strong or we had a transmission running
-    if (new_transtime >= TRANSMISSION_THRESHOLD) {
+    if (new_transtime >= c->threshold) {
       // signal is strong, so transmission is technically still running
-      if (td_fade == 0) {
+      if (c->fade == 0) {
         // start of transmission
         logging_verbose( "Start of transmission found.\n" );
-        td_sigpwr = 0;
+        c->sigpwr = 0;
+        c->truncated = 0;
+        c->rx.t_detect = trace_now();
+        if (c->next->begin != 0) {
+          c->next->begin( c->next, c->mean >> (sizeof(td_sample_t)*8) );
+          c->pushed = c->start;
+        }
       } else {
         // simply within a transmission
       }
-      td_fade = SAMPLE_RESERVOIR;
+      c->fade = c->reservoir;
       // memorize the signal amplitude
-      td_sigpwr += abs(sample);
+      c->sigpwr += abs(sample);
     } else {
       // signal is weak so transmission is over
-      td_fade--;
-      if (td_fade == 0) {
-        if ((float)td_sigpwr/(float)td_samples_i > td_mean >> (sizeof(td_sample_t)*8)) {
+      c->fade--;
+      if (c->fade == 0) {
+        int accept = 0;
+        if (c->next->begin != 0)
+          td_flush( c );
+        if (TD_STRONG( c, length )) {
           // last sample of transmission is recorded
-          if (td_samples_i < 3 * TRANSMISSION_THRESHOLD) {
-            logging_verbose( "Dropping transmission, too short: %i samples, noise floor=%i, signal=%1.0f.\n", td_samples_i, (td_mean>>(sizeof(td_sample_t)*8)), (float)td_sigpwr/(float)td_samples_i );
+          if (length < 3 * c->threshold) {
+            metrics_add( c->m_short, 1 );
+            logging_verbose( "Dropping transmission, too short: %i samples, noise floor=%i, signal=" TD_SIGNAL_FMT ".\n", length, (c->mean>>(sizeof(td_sample_t)*8)), TD_SIGNAL( c, length ) );
           } else {
-            logging_info( "Got Transmission of %i samples, noise floor=%i, signal=%1.0f.\n", td_samples_i, (td_mean>>(sizeof(td_sample_t)*8)), (float)td_sigpwr/(float)td_samples_i );
-            logging_status( 1, "n=%i, s=%1.0f, l=%i", (td_mean>>(sizeof(td_sample_t)*8)), (float)td_sigpwr/(float)td_samples_i, td_samples_i );
-            td_next->input( td_samples, td_samples_i, (td_mean>>(sizeof(td_sample_t)*8)), (int)((float)td_sigpwr/(float)td_samples_i) );
+            logging_info( "Got Transmission of %i samples, noise floor=%i, signal=" TD_SIGNAL_FMT ".\n", length, (c->mean>>(sizeof(td_sample_t)*8)), TD_SIGNAL( c, length ) );
+            logging_status( 1, "n=%i, s=" TD_SIGNAL_FMT ", l=%i", (c->mean>>(sizeof(td_sample_t)*8)), TD_SIGNAL( c, length ), length );
+            metrics_add( c->m_accepted, 1 );
+            accept = 1;
           }
         } else {
-          logging_verbose( "Transmission too weak: signal %1.0f, noise floor=%i.\n", (float)td_sigpwr/(float)td_samples_i, td_mean >> (sizeof(td_sample_t)*8) );
+          metrics_add( c->m_weak, 1 );
+          logging_verbose( "Transmission too weak: signal " TD_SIGNAL_FMT ", noise floor=%i.\n", TD_SIGNAL( c, length ), c->mean >> (sizeof(td_sample_t)*8) );
         }
+        c->rx.noise = c->mean >> (sizeof(td_sample_t)*8);
+        c->rx.signal = (int)TD_SIGNAL( c, length );
+        c->rx.sample = c->base + (int)(c->start - c->base_head);
+        c->rx.t_cut = trace_now();
+        if (c->next->begin != 0)
+          c->next->end( c->next, accept, &c->rx );
+        else if (accept)
+          c->next->input( c->next, &c->ring[c->start & (c->ring_len - 1)], length, &c->rx );
+        // the tail of the transmission is the reservoir for the next one
+        c->start = c->head - (c->reservoir - 1);
       } else {
         // still recording samples but transmission is already over.
       }
     }
   }
-  td_transtime = new_transtime;
+  c->transtime = new_transtime;
+}
+
+int td_input( sample_decoder_t *self, td_sample_t sample ) {
+  td_ctx_t *c = self->ctx;
+  metrics_add( c->m_samples, 1 );
+  c->base_head = c->head;
+  td_step( c, sample );
+  c->base++;
+  if ((c->fade != 0) && (c->next->begin != 0))
+    td_flush( c );
+  return 0;
+}
+
+/** append samples[0..length-1] to the reservoir while idle. Only the
+ * last reservoir - 1 of them are ever looked at again, so only
+ * those are written to the ring.
+ */
+static void td_reservoir_append( td_ctx_t *c, const td_sample_t samples[], size_t length ) {
+  size_t i;
+  i = length > c->reservoir - 1 ? length - (c->reservoir - 1) : 0;
+  c->head += i;
+  for (; i < length; i++) {
+    unsigned int p = c->head & (c->ring_len - 1);
+    c->ring[p] = c->ring[p + c->ring_len] = samples[i];
+    c->head++;
+  }
+  if (c->head - c->start > c->reservoir - 1)
+    c->start = c->head - (c->reservoir - 1);
+}
+
+int td_input_block( sample_decoder_t *self, const td_sample_t samples[], size_t length ) {
+  td_ctx_t *c = self->ctx;
+  /* run the detector over a whole buffer. While idle, the noise floor and
+   * the transmission counter are kept in registers and the reservoir is
+   * only updated once per idle run instead of once per sample. Anything
+   * else (start, body and end of a transmission) takes the per sample path.
+   */
+  size_t i = 0;
+  c->base_head = c->head;
+  while (i < length) {
+    if (c->fade != 0) {
+      td_step( c, samples[i++] );
+      continue;
+    }
+    // idle: scan forward until the sample that starts a transmission
+    td_sample2x_t mean = c->mean;
+    int transtime = c->transtime;
+    int threshold = c->threshold;
+    size_t start = i;
+    while (i < length) {
+      // number of samples over which the noise floor provably stays at
+      // sample_amplitude, given that none of them exceeds the threshold:
+      // each one moves c->mean by at most +-sample_amplitude. The kernel
+      // checks all of them in one call, their sum stays below 2^18.
+      td_sample_t sample_amplitude = mean >> (sizeof(td_sample_t)*8);
+      size_t n = length - i;
+      if (sample_amplitude > 0) {
+        unsigned int frac = mean & ((1<<(sizeof(td_sample_t)*8)) - 1);
+        unsigned int room = frac < (1<<(sizeof(td_sample_t)*8)) - 1 - frac ? frac : (1<<(sizeof(td_sample_t)*8)) - 1 - frac;
+        if (room / sample_amplitude + 1 < n) n = room / sample_amplitude + 1;
+      }
+      int32_t abs_sum;
+      if ((n >= TD_KERNEL_MIN) && td_kernel_quiet( &samples[i], n, SAMPLE_AMPLITUDE_FACTOR * sample_amplitude, &abs_sum )) {
+        // nothing here: every sample decrements the transmission counter
+        mean += abs_sum - (td_sample2x_t)n * sample_amplitude;
+        transtime = transtime > (int)n ? transtime - (int)n : 0;
+        i += n;
+        continue;
+      }
+      // something might be there, look at these samples one by one
+      if (n > TD_SCALAR_RUN) n = TD_SCALAR_RUN;
+      size_t end = i + n;
+      for (; i < end; i++) {
+        td_sample_t sample = samples[i];
+        sample_amplitude = mean >> (sizeof(td_sample_t)*8);
+        int new_transtime = transtime;
+        if ((sample > SAMPLE_AMPLITUDE_FACTOR * sample_amplitude) || (sample < - SAMPLE_AMPLITUDE_FACTOR * sample_amplitude)) {
+          new_transtime++;
+        } else if (new_transtime > 0) {
+          new_transtime--;
+        }
+        if (new_transtime >= threshold)
+          break;
+        mean += abs(sample) - sample_amplitude;
+        transtime = new_transtime;
+      }
+      if (i < end)
+        break;
+    }
+    c->mean = mean;
+    c->transtime = transtime;
+    td_reservoir_append( c, &samples[start], i - start );
+    // samples[i] (if any) starts a transmission
+    if (i < length)
+      td_step( c, samples[i++] );
+  }
+  // streaming bit decoders get what we have of a running transmission
+  if ((c->fade != 0) && (c->next->begin != 0))
+    td_flush( c );
+  c->base += length;
+  metrics_add( c->m_samples, length );
+  metrics_set( c->m_noise, c->mean >> (sizeof(td_sample_t)*8) );
+  return 0;
 }
 
-sample_decoder_t td = {
-  .name = "Transmission decoder for bipolar signals (e.g. FM).",
-  .shorthand = "td",
-  .init = td_init,
-  .input = td_input
-};
+void td_destroy( sample_decoder_t *self ) {
+  td_ctx_t *c = self->ctx;
+  if (c->ring != 0)
+    pool_put( pool_class( POOL_RING ), c->ring );
+  free( c );
+  free( self );
+}
+
+sample_decoder_t *td_create( void ) {
+  sample_decoder_t *self = malloc( sizeof(*self) );
+  td_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a transmission decoder.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (sample_decoder_t){
+    .name = "Transmission decoder for bipolar signals (e.g. FM).",
+    .shorthand = "td",
+    .ctx = c,
+    .init = td_init,
+    .input = td_input,
+    .input_block = td_input_block,
+    .destroy = td_destroy
+  };
+  c->mean = 500<<(sizeof(td_sample_t)*8);
+  c->threshold = srate_samples( TRANSMISSION_THRESHOLD_US );
+  c->reservoir = srate_samples( SAMPLE_RESERVOIR_US );
+  c->m_samples = metrics_counter( "rtl868_samples_total", "Samples seen by the transmission decoders." );
+  c->m_noise = metrics_gauge( "rtl868_noise_floor", "Noise floor of the last transmission decoder fed." );
+  c->m_accepted = metrics_counter( "rtl868_transmissions_total{result=\"accepted\"}", "Transmissions detected, by what became of them." );
+  c->m_short = metrics_counter( "rtl868_transmissions_total{result=\"short\"}", "" );
+  c->m_weak = metrics_counter( "rtl868_transmissions_total{result=\"weak\"}", "" );
+  return self;
+}
@@ -22,7 +22,7 @@
 #define TRANSMISSION_H 1
 
 #include "sample_decoder.h"
-extern sample_decoder_t td;
+sample_decoder_t *td_create( void );
 
 
 #endif
@@ -21,36 +21,50 @@
 // this is some other code, very similar to what is known as TX29
 // on the internet.
 
+#include <stdlib.h>
 #include "stream_decoder.h"
 #include "logging.h"
+#include "metrics.h"
+#include "trace.h"
+#include "sample_clock.h"
 #include "tools.h"
 #include "data_logger.h"
 
-data_logger_t *tx29_next;
+/* state of one tx29 decoder */
+typedef struct {
+  data_logger_t *next;
+  metric_t *m_ok;
+} tx29_ctx_t;
 
-int tx29_init( data_logger_t *next ) {
+int tx29_init( stream_decoder_t *self, data_logger_t *next ) {
+  tx29_ctx_t *c = self->ctx;
   if (next == 0) return -1;
-  tx29_next = next;
+  c->next = next;
+  crc8_init( 0x131 );
   logging_info( "TX29 decoder initialized.\n" );
+  return 0;
 }
 
-int tx29_input(int transmission[], unsigned length) {
-  // find preamble it is 2d d4 and stuff before must be aa
-  unsigned int ofs;
+// preamble is 2d d4 and stuff before must be aa
+const int tx29_magic[] = {0xaa, 0x2d, 0xd4};
+
+static int tx29_decode(stream_decoder_t *self, const uint8_t tm[], unsigned length, const rx_info_t *rx) {
+  tx29_ctx_t *c = self->ctx;
+  unsigned int ofs = length;
   int i;
-  int magic[] = {0xaa, 0x2d, 0xd4};
-  uint8_t tm[11];
-  // find magic
-  ofs = search_magic( transmission, length, tm, sizeof(tm)/sizeof(tm[0]), magic, 8*sizeof(magic)/sizeof(magic[0]) );
   if (ofs == 0) {
     return -1;
   }
   //
   logging_info( "Data packet after preamble detection: %i -> ", ofs );
-  for (i = 0; (i<sizeof(tm)/sizeof(tm[0])); i++) {
-    _logging_info( "%02x ", tm[i] );
+  for (i = 0; i < ofs; i++) {
+    logging_info_cont( "%02x ", tm[i] );
+  }
+  logging_info_cont( ".\n" );
+  if (ofs < 4) {
+    logging_warning( "Transmission too short: %i.\n", ofs );
+    return -4;
   }
-  _logging_info( ".\n" );
   // decode length
   unsigned len = (tm[3]>>4) & 0x0F;
   len = (len + 1) >> 1; // convert to bytes
@@ -59,7 +73,7 @@ int tx29_input(int transmission[], unsigned length) {
     return -4;
   }
   // check the checksum
-  uint8_t crc = crc8(0x131, &tm[3], len);
+  uint8_t crc = crc8(0x131, (uint8_t *)&tm[3], len);
   if (crc != 0) {
     logging_warning( "Invalid checksum %02x detected. Ignoring dataset.\n", crc );
     return -6;
@@ -81,15 +95,63 @@ int tx29_input(int transmission[], unsigned length) {
     return -5;
   }
   logging_info( "Recieved dataset: sensid=%i, newbatt=%i, weakbatt=%i, temp=%1.1f°C, rel_hum=%1.0f%%.\n", sensid, newbatt, weakbatt, temp, rel_hum );
-  return tx29_next->input( sensid, temp, rel_hum, newbatt | (weakbatt << 1) );
+  dl_record_t r = {
+    .time = sclock_time( rx->sample ),
+    .protocol = DL_TX29, .sensor_id = sensid,
+    .temp = temp, .rel_hum = rel_hum, .flags = newbatt | (weakbatt << 1), .rx = *rx
+  };
+  r.rx.t_decoded = trace_now();
+  return c->next->input( c->next, &r );
 }
 
+int tx29_input_aligned(stream_decoder_t *self, const uint8_t tm[], unsigned length, const rx_info_t *rx) {
+  tx29_ctx_t *c = self->ctx;
+  int res = tx29_decode( self, tm, length, rx );
+  if (res == 0)
+    metrics_add( c->m_ok, 1 );
+  return res;
+}
 
-stream_decoder_t tx29 = {
-  .name = "Decoder for TX29 weather stations.",
-  .shorthand = "tx29",
-  .init = tx29_init,
-  .input = tx29_input
-};
+int tx29_input(stream_decoder_t *self, int transmission[], unsigned length, const rx_info_t *rx) {
+  uint8_t tm[11];
+  // find magic
+  int ofs = search_magic( transmission, length, tm, sizeof(tm)/sizeof(tm[0]), (int *)tx29_magic, 8*sizeof(tx29_magic)/sizeof(tx29_magic[0]) );
+  int res = tx29_input_aligned( self, tm, ofs, rx );
+  // on its own, no other decoder takes what it rejects
+  if (res != 0)
+    metrics_add( self->rejected, 1 );
+  return res;
+}
+
+
+void tx29_destroy( stream_decoder_t *self ) {
+  free( self->ctx );
+  free( self );
+}
+
+stream_decoder_t *tx29_create( void ) {
+  stream_decoder_t *self = malloc( sizeof(*self) );
+  tx29_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a TX29 decoder.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (stream_decoder_t){
+    .name = "Decoder for TX29 weather stations.",
+    .shorthand = "tx29",
+    .ctx = c,
+    .init = tx29_init,
+    .input = tx29_input,
+    .magic = tx29_magic,
+    .magic_length = 8*sizeof(tx29_magic)/sizeof(tx29_magic[0]),
+    .input_aligned = tx29_input_aligned,
+    .destroy = tx29_destroy
+  };
+  c->m_ok = metrics_counter( "rtl868_frames_total{protocol=\"tx29\",result=\"ok\"}", "Frames handed to the protocol decoders, by result." );
+  self->rejected = metrics_counter( "rtl868_frames_total{protocol=\"tx29\",result=\"rejected\"}", "" );
+  return self;
+}
 
 
@@ -21,7 +21,9 @@
 #ifndef TX29_H
 #define TX29_H 1
 
-extern stream_decoder_t tx29;
+#include "stream_decoder.h"
+
+stream_decoder_t *tx29_create( void );
 
 
 
@@ -21,21 +21,34 @@
 // This type of data is received for example for ALDI type weather stations
 // the devices at hand have a bug, after 23.7°C, the next (upwards) step is 23.0°C
 
+#include <stdlib.h>
 #include "stream_decoder.h"
 #include "logging.h"
+#include "metrics.h"
+#include "trace.h"
+#include "sample_clock.h"
 #include "data_logger.h"
 #include "tools.h"
 
-data_logger_t *ws300_next;
+/* state of one ws300 decoder */
+typedef struct {
+  data_logger_t *next;
+  metric_t *m_ok;
+} ws300_ctx_t;
 
 
-int ws300_init( data_logger_t *next ) {
+int ws300_init( stream_decoder_t *self, data_logger_t *next ) {
+  ws300_ctx_t *c = self->ctx;
   if (next == 0) return -1;
-  ws300_next = next;  
+  c->next = next;  
   logging_info( "WS300 decoder initialized.\n" );
+  return 0;
 }
 
-int ws300_input(int transmission[], unsigned length) {
+const int ws300_magic[] = {0xaa, 0x2d, 0xd4};
+
+static int ws300_decode(stream_decoder_t *self, const uint8_t tm[], unsigned length, const rx_info_t *rx) {
+  ws300_ctx_t *c = self->ctx;
   /* decoding the result:
    *  aa aa 2d d4 51 11 4d 07 29 21 00
    *                             ^^ checksumme
@@ -47,14 +60,8 @@ int ws300_input(int transmission[], unsigned length) {
    *  ^^^^^ preamble
    * 
    */
-  int ofs;
-  int i;
-  int magic[] = {0xaa, 0x2d, 0xd4};
-  uint8_t tm[11];
-  // find magic
-  ofs = search_magic( transmission, length, tm, sizeof(tm)/sizeof(tm[0]), magic, 8*sizeof(magic)/sizeof(magic[0]) );
-  if (ofs < 8) {
-    logging_warning( "Transmission too short: %i.\n", ofs );
+  if (length < 8) {
+    logging_warning( "Transmission too short: %i.\n", length );
     return -2;
   }
   // check the preamble
@@ -75,16 +82,64 @@ int ws300_input(int transmission[], unsigned length) {
   float rel_hum = 1.0 * tm[7];
   float temp = 1.0 * tm[5] + 0.1 * tm[6] - 50.0;
   logging_info( "Recieved dataset: hauscode=%i, channel=%i, temp=%1.1f°C, rel_hum=%1.0f%%.\n", hauscode, channel, temp, rel_hum );
-  return ws300_next->input( (hauscode<<8) | channel, temp, rel_hum, 0 );
+  dl_record_t r = {
+    .time = sclock_time( rx->sample ),
+    .protocol = DL_WS300, .sensor_id = (hauscode<<8) | channel,
+    .temp = temp, .rel_hum = rel_hum, .flags = 0, .rx = *rx
+  };
+  r.rx.t_decoded = trace_now();
+  return c->next->input( c->next, &r );
+}
+
+int ws300_input_aligned(stream_decoder_t *self, const uint8_t tm[], unsigned length, const rx_info_t *rx) {
+  ws300_ctx_t *c = self->ctx;
+  int res = ws300_decode( self, tm, length, rx );
+  if (res == 0)
+    metrics_add( c->m_ok, 1 );
+  return res;
+}
+
+int ws300_input(stream_decoder_t *self, int transmission[], unsigned length, const rx_info_t *rx) {
+  uint8_t tm[11];
+  // find magic
+  int ofs = search_magic( transmission, length, tm, sizeof(tm)/sizeof(tm[0]), (int *)ws300_magic, 8*sizeof(ws300_magic)/sizeof(ws300_magic[0]) );
+  int res = ws300_input_aligned( self, tm, ofs, rx );
+  // on its own, no other decoder takes what it rejects
+  if (res != 0)
+    metrics_add( self->rejected, 1 );
+  return res;
 }
   
   
-stream_decoder_t ws300 = {
-  .name = "Decoder for WS-300 weather stations.",
-  .shorthand = "ws300",
-  .init = ws300_init,
-  .input = ws300_input
-};
+void ws300_destroy( stream_decoder_t *self ) {
+  free( self->ctx );
+  free( self );
+}
+
+stream_decoder_t *ws300_create( void ) {
+  stream_decoder_t *self = malloc( sizeof(*self) );
+  ws300_ctx_t *c = calloc( 1, sizeof(*c) );
+  if ((self == 0) || (c == 0)) {
+    logging_error( "Could not allocate a WS300 decoder.\n" );
+    free( self );
+    free( c );
+    return 0;
+  }
+  *self = (stream_decoder_t){
+    .name = "Decoder for WS-300 weather stations.",
+    .shorthand = "ws300",
+    .ctx = c,
+    .init = ws300_init,
+    .input = ws300_input,
+    .magic = ws300_magic,
+    .magic_length = 8*sizeof(ws300_magic)/sizeof(ws300_magic[0]),
+    .input_aligned = ws300_input_aligned,
+    .destroy = ws300_destroy
+  };
+  c->m_ok = metrics_counter( "rtl868_frames_total{protocol=\"ws300\",result=\"ok\"}", "Frames handed to the protocol decoders, by result." );
+  self->rejected = metrics_counter( "rtl868_frames_total{protocol=\"ws300\",result=\"rejected\"}", "" );
+  return self;
+}
 
 
   
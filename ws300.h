@@ -21,7 +21,9 @@
 #ifndef WS300_H
 #define WS300_H 1
 
-extern stream_decoder_t ws300;
+#include "stream_decoder.h"
+
+stream_decoder_t *ws300_create( void );
 
 
 